@@ -1,375 +1,466 @@
 #include "cat.h"
+#include "cat_parser.h"
+#include "cat_spectrum.h"
+#include "memory.h"
+#include "memory_index.h"
 #include "settings.h"
+#include "usb_serial.h"
 #include <cstdint>
+#include <cstdio>
+#include <cstdarg>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
 #include <algorithm>
 
 #include "pico/stdlib.h"
 
-void process_cat_control(rx_settings & settings_to_apply, rx_status & status, rx &receiver, s_settings &settings)
+struct s_cat_context
+{
+  rx_settings &settings_to_apply;
+  rx_status &status;
+  rx &receiver;
+  s_settings &settings;
+  bool settings_changed;
+};
+
+static const char mode_translation[] = "551243";
+static char vfor = '0';
+static char vfot = '0';
+static uint8_t tx_status = 0;
+static uint8_t auto_information = 0;
+
+//spectrum frames, pushed at spectrum_rate_Hz while auto information is on
+static const uint8_t spectrum_max_rate_Hz = 20;
+static const uint16_t spectrum_header_size = 8;
+static uint8_t spectrum_rate_Hz = 0;
+static bool spectrum_four_bit = false;
+static uint8_t spectrum_sequence = 0;
+static uint32_t last_spectrum_us = 0;
+
+//a reply is only sent if it fits in full, a partial reply would corrupt the stream
+static void cat_write(const char *reply, uint16_t length)
+{
+  usb_serial_write_all(USB_SERIAL_CAT, reply, length);
+}
+
+static void cat_reply(const char *format, ...)
+{
+  char reply[64];
+  va_list args;
+  va_start(args, format);
+  const int length = vsnprintf(reply, sizeof(reply), format, args);
+  va_end(args);
+  if(length > 0) cat_write(reply, std::min(length, (int)sizeof(reply)-1));
+}
+
+static void cat_fixed(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';') cat_write(command.reply, strlen(command.reply));
+}
+
+static void cat_frequency(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';')
+  {
+    cat_reply("FA%011lu;", context.settings.channel.frequency);
+    return;
+  }
+  const uint32_t frequency_Hz = strtoul(args, NULL, 10);
+  if(frequency_Hz <= 30000000)
+  {
+    context.settings.channel.frequency = frequency_Hz;
+    context.settings_changed = true;
+  }
+  else
+  {
+    cat_reply("?;");
+  }
+}
+
+static void cat_signal_strength(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';' || args[1] != ';')
+  {
+    cat_reply("?;");
+    return;
+  }
+  context.receiver.access(false);
+  float power_dBm = context.status.signal_strength_dBm;
+  context.receiver.release();
+  float power_scaled = 020*((power_dBm - (-127))/114);
+  power_scaled = std::min((float)0x20, power_scaled);
+  power_scaled = std::max((float)0, power_scaled);
+  cat_reply("SM%05X;", (uint16_t)power_scaled);
+}
+
+static void cat_mode(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  static const uint8_t modes[] = {MODE_LSB, MODE_USB, MODE_CW, MODE_FM, MODE_AM};
+  if(args[0] == ';')
+  {
+    cat_reply("MD%c;", mode_translation[context.settings.channel.mode]);
+  }
+  else if(args[0] >= '1' && args[0] <= '5')
+  {
+    context.settings.channel.mode = modes[args[0] - '1'];
+    context.settings_changed = true;
+  }
+}
+
+static void cat_information(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';')
+  {
+    cat_reply("IF%011lu     +0000000000%c%c00000 ;", context.settings.channel.frequency, mode_translation[context.settings.channel.mode], vfor);
+  }
+}
+
+static void cat_vfo(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  char &vfo = command.name[1] == 'R' ? vfor : vfot;
+  if(args[0] == ';')
+  {
+    cat_reply("%s%c;", command.name, vfo);
+  }
+  else if(args[1] == ';')
+  {
+    vfo = args[0];
+  }
+}
+
+static void cat_auto_information(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';') cat_reply("AI%u;", auto_information);
+  else if(args[0] >= '0' && args[0] <= '4' && args[1] == ';') auto_information = args[0] - '0';
+  else cat_reply("?;");
+}
+
+//ZSD<format><sequence><dB10><length lo><length hi><payload>;
+//the payload is binary and may contain ';', clients must use the length field
+static void cat_send_spectrum(rx &receiver)
+{
+  uint8_t frame[spectrum_header_size + cat_spectrum_max_payload + 1];
+  if(usb_serial_write_available(USB_SERIAL_CAT) < sizeof(frame)) return;
+
+  uint8_t spectrum[cat_spectrum_bins];
+  uint8_t dB10;
+  receiver.get_spectrum(spectrum, dB10, 1);
+  const uint16_t length = cat_encode_spectrum(spectrum, spectrum_four_bit, frame + spectrum_header_size);
+
+  frame[0] = 'Z';
+  frame[1] = 'S';
+  frame[2] = 'D';
+  frame[3] = spectrum_four_bit ? '1' : '0';
+  frame[4] = spectrum_sequence++;
+  frame[5] = dB10;
+  frame[6] = length & 0xff;
+  frame[7] = length >> 8;
+  frame[spectrum_header_size + length] = ';';
+  cat_write((const char *)frame, spectrum_header_size + length + 1);
+}
+
+static void cat_spectrum_poll(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';') cat_send_spectrum(context.receiver);
+  else cat_reply("?;");
+}
+
+//ZSR<rate Hz, 2 digits><format, 0=8-bit 1=4-bit>;
+static void cat_spectrum_rate(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';')
+  {
+    cat_reply("ZSR%02u%c;", spectrum_rate_Hz, spectrum_four_bit ? '1' : '0');
+    return;
+  }
+  const bool valid = isdigit(args[0]) && isdigit(args[1]) && (args[2] == '0' || args[2] == '1') && args[3] == ';';
+  const uint8_t rate_Hz = valid ? (args[0] - '0') * 10 + (args[1] - '0') : 0;
+  if(!valid || rate_Hz > spectrum_max_rate_Hz)
+  {
+    cat_reply("?;");
+    return;
+  }
+  spectrum_rate_Hz = rate_Hz;
+  spectrum_four_bit = args[2] == '1';
+}
+
+//fake TX for now
+static void cat_transmit(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(args[0] == ';') cat_reply("TX%d;", tx_status);
+  else if(args[0] == '1') tx_status = 1;
+  else if(args[0] == '0') tx_status = 0;
+  else cat_reply("?;");
+}
+
+//ZDN<channel, 3 hex digits><16 words, 8 hex digits each>;
+static const uint16_t memory_reply_length = 6 + 16*8 + 1;
+
+//sends the channel exactly as stored, so the words match the sector CRC
+static void cat_send_channel(uint16_t channel_number)
+{
+  const uint32_t *words = radio_memory[channel_number];
+
+  char reply[memory_reply_length + 1];
+  uint16_t length = snprintf(reply, sizeof(reply), "ZDN%03x", channel_number);
+  for(uint8_t word_idx=0; word_idx<16; ++word_idx)
+  {
+    length += snprintf(reply + length, sizeof(reply) - length, "%08lx", words[word_idx]);
+  }
+  reply[length++] = ';';
+  cat_write(reply, length);
+}
+
+//parses a channel number (3 hex digits) followed by 16 words (8 hex digits each)
+static bool cat_parse_channel(const char *args, uint16_t &channel_number, uint32_t words[16])
 {
-    const uint16_t buffer_length = 256;
-    static char buf[buffer_length];
-    static uint16_t read_idx = 0;
-    static uint16_t write_idx = 0;
-    static uint16_t items_in_buffer = 0;
+  if(strlen(args) != 3 + 16*8 + 1 || args[3 + 16*8] != ';') return false;
 
-    //write any new data into circular buffer
+  //Extract channel number
+  char channel_string[4];
+  memcpy(channel_string, args, 3); channel_string[3] = 0;
+  channel_number = strtoul(channel_string, NULL, 16);
+  if(channel_number >= num_chans) return false;
+
+  //Read word data
+  for(uint8_t word_idx=0; word_idx<16; ++word_idx)
+  {
+    char word_string[9];
+    memcpy(word_string, &args[(word_idx * 8) + 3], 8); word_string[8] = 0;
+    words[word_idx] = strtoul(word_string, NULL, 16);
+  }
+  return true;
+}
+
+static void cat_memory_download(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  if(strlen(args) != 3 + 1 || args[3] != ';')
+  {
+    cat_reply("?;");
+    return;
+  }
+
+  char channel_string[4];
+  memcpy(channel_string, args, 3); channel_string[3] = 0;
+  uint32_t channel_number = strtoul(channel_string, NULL, 16);
+  if(channel_number >= num_chans)
+  {
+    cat_reply("?;");
+    return;
+  }
+  cat_send_channel(channel_number);
+}
+
+static void cat_memory_upload(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  uint16_t channel_number;
+  uint32_t words[16];
+  if(!cat_parse_channel(args, channel_number, words))
+  {
+    cat_reply("?;");
+    return;
+  }
+
+  s_memory_channel memory_channel;
+  memcpy(&memory_channel, words, sizeof(memory_channel));
+  memory_store_channel(memory_channel, channel_number, context.settings, context.receiver, context.settings_to_apply);
+  cat_reply("ZUP%03x;", channel_number);
+}
+
+//Bulk memory transfer
+//
+//ZMW stages a channel in RAM without a reply, so a host can send a whole
+//sector (64 channels) without waiting. ZMC then programs the sector once,
+//provided the CRC-16 of the staged 4KB sector image matches. ZMR streams a
+//sector as 64 ZDN replies followed by its CRC.
+
+//returns a value that is out of range for any field if a digit is not hex
+static uint32_t hex_value(const char *text, uint8_t digits)
+{
+  uint32_t value = 0;
+  for(uint8_t idx=0; idx<digits; ++idx)
+  {
+    if(!isxdigit(text[idx])) return UINT32_MAX;
+    value = (value << 4) | (isdigit(text[idx]) ? text[idx] - '0' : (tolower(text[idx]) - 'a' + 10));
+  }
+  return value;
+}
+
+//ZMW<channel, 3 hex digits><16 words, 8 hex digits each>;
+static void cat_memory_write(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  uint16_t channel_number;
+  uint32_t words[16];
+  if(cat_parse_channel(args, channel_number, words)) memory_stage_channel(channel_number, words);
+  else cat_reply("?;");
+}
+
+//ZMC<sector, 1 hex digit><crc, 4 hex digits>; replies ZMC<sector>; once programmed,
+//O; if a memory store from the front panel replaced the staged sector
+static void cat_memory_commit(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  const bool valid = strlen(args) == 1 + 4 + 1 && args[5] == ';';
+  const uint32_t sector = valid ? hex_value(args, 1) : UINT32_MAX;
+  const uint32_t crc = valid ? hex_value(args + 1, 4) : UINT32_MAX;
+  const e_memory_commit result = sector < memory_sectors && crc <= 0xffff ?
+      memory_commit_sector(sector, crc, context.settings, context.receiver, context.settings_to_apply) :
+      MEMORY_COMMIT_FAILED;
+  if(result == MEMORY_COMMIT_OK)
+  {
+    cat_reply("ZMC%lx;", sector);
+  }
+  else if(result == MEMORY_COMMIT_INTERRUPTED)
+  {
+    cat_reply("O;");
+  }
+  else
+  {
+    cat_reply("?;");
+  }
+}
+
+//sector being streamed by ZMR, the replies are sent as CAT buffer space allows
+static const uint16_t export_space = memory_reply_length + 16; //also leaves room for the final ZMR reply
+static uint16_t export_channel = 0;
+static uint16_t export_end = 0;
+
+//ZMR<sector, 1 hex digit>; replies ZDN for each channel then ZMR<sector><crc>;
+static void cat_memory_read(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  const uint32_t sector = strlen(args) == 1 + 1 && args[1] == ';' ? hex_value(args, 1) : UINT32_MAX;
+  if(sector >= memory_sectors || export_channel != export_end)
+  {
+    cat_reply("?;");
+    return;
+  }
+  export_channel = sector * memory_channels_per_sector;
+  export_end = export_channel + memory_channels_per_sector;
+}
+
+static void cat_memory_export()
+{
+  while(export_channel != export_end && usb_serial_write_available(USB_SERIAL_CAT) >= export_space)
+  {
+    cat_send_channel(export_channel++);
+    if(export_channel == export_end)
     {
-      const uint16_t bytes_to_end = buffer_length-write_idx;
-      int32_t retval = stdio_get_until(buf+write_idx, bytes_to_end, make_timeout_time_us(100));
-      if(retval != PICO_ERROR_TIMEOUT)
-      {
-        items_in_buffer += retval;
-        write_idx += retval;
-        if(write_idx >= buffer_length) write_idx -= buffer_length;
-      }
+      const uint16_t sector = (export_end - 1) / memory_channels_per_sector;
+      cat_reply("ZMR%x%04x;", sector, memory_sector_crc(sector));
     }
+  }
+}
+
+//ZMF<frequency Hz>; replies ZMF<channel>; with the channel closest in frequency
+static void cat_memory_find(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  const uint16_t channel_number = isdigit(args[0]) ? memory_index_nearest(strtoul(args, NULL, 10)) : memory_index_none;
+  if(channel_number == memory_index_none) cat_reply("?;");
+  else cat_reply("ZMF%03x;", channel_number);
+}
+
+//ZML<start channel, 3 hex digits><label prefix>; replies ZML<channel>; with
+//the first match from the start channel on, send the next channel to continue
+static void cat_memory_label(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  const uint32_t start_channel = strlen(args) > 3 ? hex_value(args, 3) : UINT32_MAX;
+  char prefix[17] = {0};
+  if(start_channel < num_chans) strncpy(prefix, args + 3, std::min<size_t>(strlen(args + 3) - 1, 16));
+  const uint16_t channel_number = start_channel < num_chans ? memory_index_search(prefix, start_channel) : memory_index_none;
+  if(channel_number == memory_index_none) cat_reply("?;");
+  else cat_reply("ZML%03x;", channel_number);
+}
 
+//must be kept in sorted order, looked up by binary search
+static const s_cat_command cat_commands[] = {
+  {"AC", cat_fixed, "AC010;"},
+  {"AG", cat_fixed, "AG0;"},
+  {"AI", cat_auto_information, NULL},
+  {"BC", cat_fixed, "BC0;"},
+  {"EX", cat_fixed, "EX000000000;"},
+  {"FA", cat_frequency, NULL},
+  {"FB", cat_frequency, NULL},
+  {"FL", cat_fixed, "FL0;"},
+  {"FR", cat_vfo, NULL},
+  {"FT", cat_vfo, NULL},
+  {"FW", cat_fixed, "FW0000;"},
+  {"GT", cat_fixed, "GT000;"},
+  {"ID", cat_fixed, "ID020;"},
+  {"IF", cat_information, NULL},
+  {"IS", cat_fixed, "IS+0000;"},
+  {"KS", cat_fixed, "KS010;"},
+  {"LK", cat_fixed, "LK00;"},
+  {"MD", cat_mode, NULL},
+  {"MG", cat_fixed, "MG000;"},
+  {"ML", cat_fixed, "ML000;"},
+  {"NB", cat_fixed, "NB0;"},
+  {"NR", cat_fixed, "NR0;"},
+  {"PA", cat_fixed, "PA00;"},
+  {"PC", cat_fixed, "PC005;"},
+  {"PL", cat_fixed, "PL000000;"},
+  {"PR", cat_fixed, "PR0;"},
+  {"PS", cat_fixed, "PS1;"},
+  {"RA", cat_fixed, "RA0000;"},
+  {"RC", cat_fixed, "RC;"},
+  {"RG", cat_fixed, "RG000;"},
+  {"RL", cat_fixed, "RL00;"},
+  {"RM", cat_fixed, "RM10000;"},
+  {"RS", cat_fixed, "RS0;"},
+  {"RT", cat_fixed, "RT1;"},
+  {"SD", cat_fixed, "SD0000;"},
+  {"SH", cat_fixed, "SH00;"},
+  {"SL", cat_fixed, "SL00;"},
+  {"SM", cat_signal_strength, NULL},
+  {"SQ", cat_fixed, "SQ0000;"},
+  {"TX", cat_transmit, NULL},
+  {"VD", cat_fixed, "VD0000;"},
+  {"VG", cat_fixed, "VG000;"},
+  {"VX", cat_fixed, "VX0;"},
+  {"XT", cat_fixed, "XT1;"},
+  {"ZDN", cat_memory_download, NULL},
+  {"ZMC", cat_memory_commit, NULL},
+  {"ZMF", cat_memory_find, NULL},
+  {"ZML", cat_memory_label, NULL},
+  {"ZMR", cat_memory_read, NULL},
+  {"ZMW", cat_memory_write, NULL},
+  {"ZSP", cat_spectrum_poll, NULL},
+  {"ZSR", cat_spectrum_rate, NULL},
+  {"ZUP", cat_memory_upload, NULL},
+};
 
-    //copy command from circular buffer to command buffer
-    static char cmd[buffer_length];
-    const uint16_t bytes_to_read = items_in_buffer;
-    const uint16_t bytes_to_end = std::min(bytes_to_read, (uint16_t)(buffer_length-read_idx));
-    const uint16_t bytes_remaining = bytes_to_read - bytes_to_end;
-    memcpy(cmd, buf+read_idx, bytes_to_end);
-    memcpy(cmd+bytes_to_end, buf, bytes_remaining);
-
-    //read command from circular_buffer
-    char *command_end = (char*)memchr(cmd, ';', items_in_buffer);
-    if(command_end == NULL) {
-      //buffer full discard
-      if(items_in_buffer == buffer_length){
-        items_in_buffer = 0;
-        read_idx = 0;
-        write_idx = 0;
-      }
-      return;
-    }
+static cat_parser parser(cat_commands, sizeof(cat_commands)/sizeof(cat_commands[0]));
 
-    //remove the command from circular buffer
-    uint32_t command_length = command_end - cmd + 1;
-    read_idx += command_length;
-    if(read_idx > buffer_length) read_idx -= buffer_length;
-    items_in_buffer -= command_length;
-
-    bool settings_changed = false;
-    const char mode_translation[] = "551243";
-    static char vfor = '0';
-    static char vfot = '0';
-
-    if (strncmp(cmd, "FA", 2) == 0) {
-
-        // Handle mode set/get commands
-        if (cmd[2] == ';') {
-            printf("FA%011lu;", settings.channel.frequency);
-        } else {
-            uint32_t frequency_Hz;
-            sscanf(cmd+2, "%lu", &frequency_Hz);
-            if(frequency_Hz <= 30000000)
-            {
-              settings.channel.frequency=frequency_Hz;
-              settings_changed = true;
-            }
-            else
-            {
-              printf("?;");
-            }
-        }
-
-    } else if (strncmp(cmd, "FB", 2) == 0) {
-
-        // Handle mode set/get commands
-        if (cmd[2] == ';') {
-            printf("FA%011lu;", settings.channel.frequency);
-        } else {
-            uint32_t frequency_Hz;
-            sscanf(cmd+2, "%lu", &frequency_Hz);
-            if(frequency_Hz <= 30000000)
-            {
-              settings.channel.frequency=frequency_Hz;
-              settings_changed = true;
-            }
-            else
-            {
-              printf("?;");
-            }
-        }
-
-    } else if (strncmp(cmd, "SM", 2) == 0) {
-
-        // Handle mode set/get commands
-        if (cmd[3] == ';') {
-            receiver.access(false);
-            float power_dBm = status.signal_strength_dBm;
-            receiver.release();
-            float power_scaled = 020*((power_dBm - (-127))/114);
-            power_scaled = std::min((float)0x20, power_scaled);
-            power_scaled = std::max((float)0, power_scaled);
-            printf("SM%05X;", (uint16_t)power_scaled);
-        } else {
-            printf("?;");
-        }
-
-    } else if (strncmp(cmd, "MD", 2) == 0) {
-
-        // Handle mode set/get commands
-        if (cmd[2] == ';') {
-            char mode_status = mode_translation[settings.channel.mode];
-            printf("MD%c;", mode_status);
-        } else if (cmd[2] == '1') {
-            settings_changed = true;
-            settings.channel.mode = MODE_LSB;
-        } else if (cmd[2] == '2') {
-            settings_changed = true;
-            settings.channel.mode = MODE_USB;
-        } else if (cmd[2] == '3') {
-            settings_changed = true;
-            settings.channel.mode = MODE_CW;
-        } else if (cmd[2] == '4') {
-            settings_changed = true;
-            settings.channel.mode = MODE_FM;
-        } else if (cmd[2] == '5') {
-            settings_changed = true;
-            settings.channel.mode = MODE_AM;
-        }
-
-    } else if (strncmp(cmd, "IF", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("IF%011lu     +0000000000%c%c00000 ;", settings.channel.frequency, mode_translation[settings.channel.mode], vfor);
-        }
-
-    //fake TX for now
-    } else if (strncmp(cmd, "ID", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("ID020;");
-        }
-    } else if (strncmp(cmd, "FR", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("FR%c;", vfor);
-        }
-        else if(cmd[3] == ';'){
-            vfor = cmd[2];
-        }
-    } else if (strncmp(cmd, "FT", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("FT%c;", vfot);
-        }
-        else if(cmd[3] == ';'){
-            vfot = cmd[2];
-        }
-    } else if (strncmp(cmd, "AI", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("AI0;");
-        }
-    } else if (strncmp(cmd, "AG", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("AG0;");
-        }
-    } else if (strncmp(cmd, "XT", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("XT1;");
-        }
-    } else if (strncmp(cmd, "RT", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("RT1;");
-        }
-    } else if (strncmp(cmd, "RC", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("RC;");
-        }
-    } else if (strncmp(cmd, "FL", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("FL0;");
-        }
-    } else if (strncmp(cmd, "PS", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("PS1;");
-        }
-    } else if (strncmp(cmd, "VX", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("VX0;");
-        }
-    } else if (strncmp(cmd, "RS", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("RS0;");
-        }
-    } else if (strncmp(cmd, "FL", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("FL0;");
-        }
-    } else if (strncmp(cmd, "AC", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("AC010;");
-        }
-    } else if (strncmp(cmd, "SL", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("SL00;");
-        }
-    } else if (strncmp(cmd, "SH", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("SH00;");
-        }
-    } else if (strncmp(cmd, "IS", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("IS+0000;");
-        }
-    } else if (strncmp(cmd, "PR", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("PR0;");
-        }
-    } else if (strncmp(cmd, "NB", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("NB0;");
-        }
-    } else if (strncmp(cmd, "LK", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("LK00;");
-        }
-    } else if (strncmp(cmd, "MG", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("MG000;");
-        }
-    } else if (strncmp(cmd, "PL", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("PL000000;");
-        }
-    } else if (strncmp(cmd, "VD", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("VD0000;");
-        }
-    } else if (strncmp(cmd, "VG", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("VG000;");
-        }
-    } else if (strncmp(cmd, "BC", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("BC0;");
-        }
-    } else if (strncmp(cmd, "ML", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("ML000;");
-        }
-    } else if (strncmp(cmd, "NR", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("NR0;");
-        }
-    } else if (strncmp(cmd, "SD", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("SD0000;");
-        }
-    } else if (strncmp(cmd, "KS", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("KS010;");
-        }
-    } else if (strncmp(cmd, "EX", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("EX000000000;");
-        }
-    } else if (strncmp(cmd, "RL", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("RL00;");
-        }
-    } else if (strncmp(cmd, "SQ", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("SQ0000;");
-        }
-    } else if (strncmp(cmd, "RG", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("RG000;");
-        }
-    } else if (strncmp(cmd, "RM", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("RM10000;");
-        }
-    } else if (strncmp(cmd, "PA", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("PA00;");
-        }
-    } else if (strncmp(cmd, "RA", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("RA0000;");
-        }
-    } else if (strncmp(cmd, "GT", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("GT000;");
-        }
-    } else if (strncmp(cmd, "PC", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("PC005;");
-        }
-    } else if (strncmp(cmd, "FW", 2) == 0) {
-        if (cmd[2] == ';') {
-            printf("FW0000;");
-        }
-    } else if (strncmp(cmd, "TX", 2) == 0) {
-        static uint8_t tx_status = 0;
-
-        // Set or Get TX mode command (TX)
-        if (cmd[2] == ';') {
-            // Get current transmit status
-            printf("TX%d;", tx_status);
-        } else if (cmd[2] == '1') {
-            // Switch to TX mode
-            tx_status = 1;
-        } else if (cmd[2] == '0') {
-            // Switch to RX mode
-            tx_status = 0;
-        } else {
-            // Invalid TX command format
-            printf("?;");
-        }
-
-    } else if (strncmp(cmd, "ZUP", 3) == 0) {
-        if (cmd[134] == ';') {
-
-          //Extract channel number
-          char channel_string[4];
-          memcpy(channel_string, &cmd[3], 3); cmd[3] = 0;
-          uint32_t channel_number = strtoul(channel_string, NULL, 16);
-
-          //Read word data
-          uint32_t words[16];
-          for(uint8_t word_idx=0; word_idx<16; ++word_idx)
-          {
-            char word_string[9];
-            memcpy(word_string, &cmd[(word_idx * 8) + 6], 8); word_string[8] = 0;
-            words[word_idx] = strtoul(word_string, NULL, 16);
-          }
-
-          s_memory_channel memory_channel;
-          memcpy(&memory_channel, words, sizeof(memory_channel));
-          memory_store_channel(memory_channel, channel_number, settings, receiver, settings_to_apply);
-          printf("ZUP%03lx;", channel_number);
-
-        } else {
-            printf("?;");
-        }
-    } else if (strncmp(cmd, "ZDN", 3) == 0) {
-        if (cmd[6] == ';') {
-          char channel_string[4];
-          memcpy(channel_string, &cmd[3], 3); cmd[3] = 0;
-          uint32_t channel_number = strtoul(channel_string, NULL, 16);
-
-          printf("ZDN%03lx", channel_number);
-          s_memory_channel memory_channel = get_channel(channel_number);
-          uint32_t words[16];
-          memcpy(words, &memory_channel, sizeof(memory_channel));
-          for(uint8_t word_idx=0; word_idx<16; ++word_idx)
-          {
-            printf("%08lx", words[word_idx]);
-          }
-          printf(";");
-
-        } else {
-            printf("?;");
-        }
-    } else {
-        // Unknown command
-        printf("?;");
+void process_cat_control(rx_settings & settings_to_apply, rx_status & status, rx &receiver, s_settings &settings)
+{
+  s_cat_context context = {settings_to_apply, status, receiver, settings, false};
+
+  //feed any new bytes through the parser, dispatching each complete command
+  uint8_t chunk[64];
+  uint32_t bytes_read;
+  while((bytes_read = usb_serial_read(USB_SERIAL_CAT, chunk, sizeof(chunk))))
+  {
+    for(uint32_t idx = 0; idx < bytes_read; ++idx)
+    {
+      if(!parser.feed(chunk[idx])) continue;
+      const s_cat_command *command = parser.command();
+      if(command) command->handler(context, *command, parser.args());
+      else cat_reply("?;");
     }
+  }
+
+  //push spectrum frames to remote panadapters
+  if(auto_information && spectrum_rate_Hz && time_us_32() - last_spectrum_us >= 1000000u / spectrum_rate_Hz)
+  {
+    last_spectrum_us = time_us_32();
+    cat_send_spectrum(receiver);
+  }
 
-    //apply settings to receiver
-    apply_settings_to_rx(receiver, settings_to_apply, settings, false, settings_changed);
+  //stream any bulk memory export
+  cat_memory_export();
 
+  //apply settings to receiver
+  if(context.settings_changed)
+  {
+    apply_settings_to_rx(receiver, settings_to_apply, settings, false, true);
+  }
 }
@@ -0,0 +1,85 @@
+#include "cat_parser.h"
+#include <cstring>
+
+cat_parser::cat_parser(const s_cat_command commands[], uint16_t num_commands) :
+  commands(commands), num_commands(num_commands)
+{
+}
+
+bool cat_parser::feed(char c)
+{
+  //discard the remainder of an over-length command
+  if(overflow)
+  {
+    if(c != ';') return false;
+    overflow = false;
+    matched = nullptr;
+    return true;
+  }
+
+  //ignore line endings and padding between commands
+  if(length == 0 && (c == '\r' || c == '\n' || c == ' ')) return false;
+
+  if(length == cat_max_command_length)
+  {
+    length = 0;
+    if(c != ';')
+    {
+      overflow = true;
+      return false;
+    }
+    matched = nullptr;
+    return true;
+  }
+
+  buffer[length++] = c;
+  if(c != ';') return false;
+
+  buffer[length] = 0;
+  length = 0;
+  matched = lookup();
+  return true;
+}
+
+//binary search, the buffer is null terminated so the comparison always stops
+const s_cat_command *cat_parser::lookup()
+{
+  uint16_t low = 0;
+  uint16_t high = num_commands;
+  while(low < high)
+  {
+    const uint16_t mid = (low + high) >> 1;
+    const char *name = commands[mid].name;
+    int16_t difference = 0;
+    uint16_t idx = 0;
+    for(; name[idx]; ++idx)
+    {
+      if(buffer[idx] != name[idx])
+      {
+        difference = (int16_t)(uint8_t)buffer[idx] - (int16_t)(uint8_t)name[idx];
+        break;
+      }
+    }
+    if(difference == 0)
+    {
+      name_length = idx;
+      return &commands[mid];
+    }
+    if(difference < 0) high = mid;
+    else low = mid + 1;
+  }
+  name_length = 0;
+  return nullptr;
+}
+
+bool cat_parser::table_is_sorted(const s_cat_command commands[], uint16_t num_commands)
+{
+  for(uint16_t idx = 1; idx < num_commands; ++idx)
+  {
+    const char *a = commands[idx-1].name;
+    const char *b = commands[idx].name;
+    if(strcmp(a, b) >= 0) return false;
+    if(strncmp(a, b, strlen(a)) == 0) return false;
+  }
+  return true;
+}
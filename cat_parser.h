@@ -0,0 +1,53 @@
+#ifndef __cat_parser__
+#define __cat_parser__
+
+#include <cstdint>
+
+//longest command is ZUP: 3 character name + 3 digit channel + 128 hex digits
+static const uint16_t cat_max_command_length = 160u;
+
+struct s_cat_context;
+struct s_cat_command;
+typedef void (*cat_handler_t)(s_cat_context &context, const s_cat_command &command, const char *args);
+
+struct s_cat_command
+{
+  const char *name;
+  cat_handler_t handler;
+  const char *reply; //fixed reply for commands that are not implemented
+};
+
+//incremental parser, bytes are fed in as they arrive and a command is looked
+//up once the ';' terminator is seen. The command table must be sorted by name
+//and no name may be a prefix of another.
+class cat_parser
+{
+  public:
+
+  cat_parser(const s_cat_command commands[], uint16_t num_commands);
+
+  //returns true when a complete command has been received
+  bool feed(char c);
+
+  //valid after feed() returns true, NULL if the command is unknown or too long
+  const s_cat_command *command() const {return matched;}
+
+  //arguments following the command name, including the ';' terminator
+  const char *args() const {return buffer + name_length;}
+
+  static bool table_is_sorted(const s_cat_command commands[], uint16_t num_commands);
+
+  private:
+
+  const s_cat_command *lookup();
+
+  const s_cat_command *commands;
+  uint16_t num_commands;
+  const s_cat_command *matched = nullptr;
+  char buffer[cat_max_command_length + 1];
+  uint16_t length = 0;
+  uint16_t name_length = 0;
+  bool overflow = false;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "cat_spectrum.h"
+
+uint16_t cat_encode_spectrum(const uint8_t spectrum[], bool four_bit, uint8_t payload[])
+{
+  uint16_t nibbles = 0;
+  auto emit = [&](uint8_t nibble)
+  {
+    if(nibbles & 1) payload[nibbles >> 1] |= nibble & 0xf;
+    else payload[nibbles >> 1] = (nibble & 0xf) << 4;
+    ++nibbles;
+  };
+
+  int16_t previous = 0;
+  for(uint16_t idx = 0; idx < cat_spectrum_bins; ++idx)
+  {
+    const int16_t value = four_bit ? spectrum[idx] >> 4 : spectrum[idx];
+    const int16_t delta = value - previous;
+    previous = value;
+    if(delta >= -7 && delta <= 7)
+    {
+      emit(delta);
+      continue;
+    }
+    emit(cat_spectrum_escape);
+    if(!four_bit) emit(value >> 4);
+    emit(value);
+  }
+
+  //an odd nibble count is padded with a zero delta, decoders stop after 256 bins
+  return (nibbles + 1) >> 1;
+}
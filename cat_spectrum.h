@@ -0,0 +1,16 @@
+#ifndef __cat_spectrum__
+#define __cat_spectrum__
+
+#include <cstdint>
+
+//Spectrum frames are delta coded as a stream of 4-bit nibbles, packed high
+//nibble first. A delta in the range -7 to 7 is sent as a single nibble, any
+//other value is sent as an escape nibble (0x8) followed by the absolute value
+//(2 nibbles in 8-bit mode, 1 nibble in 4-bit mode).
+static const uint16_t cat_spectrum_bins = 256u;
+static const uint8_t cat_spectrum_escape = 0x8u;
+static const uint16_t cat_spectrum_max_payload = (cat_spectrum_bins * 3u + 1u) / 2u;
+
+uint16_t cat_encode_spectrum(const uint8_t spectrum[], bool four_bit, uint8_t payload[]);
+
+#endif
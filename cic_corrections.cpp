@@ -27,3 +27,19 @@ int16_t cic_correct(int16_t fft_bin, int16_t fft_offset, int16_t sample)
   int32_t adjusted_sample = ((int32_t)sample * cic_correction[unsigned_fft_bin]) >> 8;
   return std::max(std::min(adjusted_sample, (int32_t)INT16_MAX), (int32_t)INT16_MIN);
 }
+
+void remove_dc_spur(uint16_t magnitude[], int16_t first_bin, uint16_t bins, int16_t fft_offset)
+{
+  const int16_t dc = -fft_offset - first_bin;
+  if(dc < -1 || dc > (int16_t)bins) return;
+  const int16_t left = dc - 2;
+  const int16_t right = dc + 2;
+  const bool have_left = left >= 0;
+  const bool have_right = right < (int16_t)bins;
+  if(!have_left && !have_right) return;
+  const uint16_t fill = !have_left ? magnitude[right] : !have_right ? magnitude[left] : std::min(magnitude[left], magnitude[right]);
+  for(int16_t bin = dc - 1; bin <= dc + 1; ++bin)
+  {
+    if(bin >= 0 && bin < (int16_t)bins) magnitude[bin] = fill;
+  }
+}
@@ -5,4 +5,9 @@
 extern const uint16_t cic_correction[];
 int16_t cic_correct(int16_t fft_bin, int16_t fft_offset, int16_t sample);
 
+//the NCO sits at bin -fft_offset, any residual DC there shows as a spur. The
+//bins around it take the lower of their outer neighbours. magnitude[0] is
+//signed bin first_bin.
+void remove_dc_spur(uint16_t magnitude[], int16_t first_bin, uint16_t bins, int16_t fft_offset);
+
 #endif
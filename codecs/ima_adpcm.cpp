@@ -0,0 +1,73 @@
+#include "ima_adpcm.h"
+
+static const int16_t step_table[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767};
+
+static const int8_t index_table[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+void ima_adpcm_encoder :: reset()
+{
+  count = 0;
+  predictor = 0;
+  index = 0;
+}
+
+//quantise the prediction error, updating the decoder model exactly as a decoder would
+uint8_t ima_adpcm_encoder :: encode(int16_t sample)
+{
+  const int16_t step = step_table[index];
+  int32_t difference = sample - predictor;
+  uint8_t code = 0;
+  if(difference < 0)
+  {
+    code = 8;
+    difference = -difference;
+  }
+
+  int32_t delta = step >> 3;
+  if(difference >= step) {code |= 4; difference -= step; delta += step;}
+  if(difference >= step >> 1) {code |= 2; difference -= step >> 1; delta += step >> 1;}
+  if(difference >= step >> 2) {code |= 1; delta += step >> 2;}
+
+  predictor += (code & 8) ? -delta : delta;
+  if(predictor > 32767) predictor = 32767;
+  if(predictor < -32768) predictor = -32768;
+
+  index += index_table[code];
+  if(index < 0) index = 0;
+  if(index > 88) index = 88;
+  return code;
+}
+
+//returns true when a complete block is ready
+bool ima_adpcm_encoder :: push(int16_t sample)
+{
+  if(count == 0)
+  {
+    //the first sample of each block is stored verbatim in the header
+    predictor = sample;
+    block[0] = sample & 0xff;
+    block[1] = (uint16_t)sample >> 8;
+    block[2] = index;
+    block[3] = 0;
+  }
+  else
+  {
+    const uint16_t nibble = count - 1;
+    const uint8_t code = encode(sample);
+    uint8_t &byte = block[4 + (nibble >> 1)];
+    if(nibble & 1) byte |= code << 4;
+    else byte = code;
+  }
+
+  if(++count < samples_per_block) return false;
+  count = 0;
+  return true;
+}
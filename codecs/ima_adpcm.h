@@ -0,0 +1,32 @@
+#ifndef IMA_ADPCM_H__
+#define IMA_ADPCM_H__
+
+#include <cstdint>
+
+// mono IMA-ADPCM encoder producing standard WAV (format 0x11) blocks
+//
+// each block holds a 4 byte header (first sample and step index) followed
+// by 4-bit codes, low nibble first. Samples are pushed one at a time and a
+// block becomes available every samples_per_block samples.
+class ima_adpcm_encoder
+{
+  public:
+
+  static const uint16_t block_size = 256u;
+  static const uint16_t samples_per_block = (block_size - 4u) * 2u + 1u;
+
+  void reset();
+  bool push(int16_t sample);
+  const uint8_t *get_block() const {return block;}
+
+  private:
+
+  uint8_t encode(int16_t sample);
+
+  uint8_t block[block_size];
+  uint16_t count = 0;
+  int32_t predictor = 0;
+  int8_t index = 0;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "recording_reader.h"
+#include "rice_iq.h"
+#include <cstring>
+
+static uint16_t get16(const uint8_t *data) {return data[0] | (data[1] << 8);}
+static uint32_t get32(const uint8_t *data) {return get16(data) | ((uint32_t)get16(data + 2) << 16);}
+
+//reads at most the number of data bytes left in the recording
+uint32_t recording_reader :: fetch(uint8_t buffer[], uint32_t bytes)
+{
+  if(bytes > remaining) bytes = remaining;
+  const uint32_t n = read_bytes(context, buffer, bytes);
+  remaining -= n;
+  return n;
+}
+
+bool recording_reader :: skip(uint32_t bytes)
+{
+  uint8_t discard[64];
+  while(bytes)
+  {
+    const uint32_t n = bytes < sizeof(discard) ? bytes : sizeof(discard);
+    if(read_bytes(context, discard, n) != n) return false;
+    bytes -= n;
+  }
+  return true;
+}
+
+//walk the chunks up to "data", anything other than 16-bit PCM is rejected
+bool recording_reader :: open_wav()
+{
+  bool have_format = false;
+  while(true)
+  {
+    uint8_t chunk[8];
+    if(read_bytes(context, chunk, 8) != 8) return false;
+    const uint32_t size = get32(chunk + 4);
+    if(memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+    {
+      uint8_t format[16];
+      if(read_bytes(context, format, 16) != 16) return false;
+      const uint16_t tag = get16(format);
+      if((tag != 1 && tag != 0xfffe) || get16(format + 14) != 16) return false;
+      num_channels = get16(format + 2);
+      rate = get32(format + 4);
+      have_format = num_channels == 1 || num_channels == 2;
+      if(!skip(size - 16 + (size & 1))) return false;
+    }
+    else if(memcmp(chunk, "data", 4) == 0)
+    {
+      remaining = size;
+      return have_format;
+    }
+    else if(!skip(size + (size & 1)))
+    {
+      return false;
+    }
+  }
+}
+
+//header layout is written by sdcard.cpp and read by utils/decode_recording.py
+bool recording_reader :: open_riq()
+{
+  uint8_t header[512 - 4];
+  if(read_bytes(context, header, sizeof(header)) != sizeof(header)) return false;
+  if(get16(header) != 1) return false;
+  rate = get32(header + 2);
+  num_channels = get16(header + 6);
+  frame_pairs = get16(header + 8);
+  remaining = get32(header + 10);
+  lossless = true;
+  return num_channels == 2 && frame_pairs > 0 && frame_pairs <= max_frame_pairs;
+}
+
+bool recording_reader :: open(recording_read_t read, void *read_context)
+{
+  read_bytes = read;
+  context = read_context;
+  lossless = false;
+  num_channels = 0;
+  rate = 0;
+  remaining = 0;
+  frame_position = frame_samples = 0;
+
+  uint8_t magic[12];
+  if(read_bytes(context, magic, 4) != 4) return false;
+  if(memcmp(magic, "PRIQ", 4) == 0) return open_riq();
+  if(read_bytes(context, magic + 4, 8) != 8) return false;
+  if(memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WAVE", 4) == 0) return open_wav();
+  return false;
+}
+
+bool recording_reader :: next_frame()
+{
+  frame_position = frame_samples = 0;
+  if(fetch(frame, 2) != 2) return false;
+  const uint16_t bytes = rice_iq_frame_bytes(frame);
+  if(bytes > rice_iq_max_frame_bytes(frame_pairs)) return false;
+  if(fetch(frame + 2, bytes - 2) != bytes - 2u) return false;
+  if(!rice_iq_decode(frame, frame_pairs, decoded)) return false;
+  frame_samples = 2 * frame_pairs;
+  return true;
+}
+
+//returns the number of samples read, fewer than count at the end of the recording
+uint16_t recording_reader :: read(int16_t samples[], uint16_t count)
+{
+  if(!lossless)
+  {
+    //wav data is little endian, as are the rp2040 and the host
+    return fetch((uint8_t*)samples, 2u * count) / 2u;
+  }
+
+  uint16_t n = 0;
+  while(n < count)
+  {
+    if(frame_position == frame_samples && !next_frame()) break;
+    const uint16_t available = frame_samples - frame_position;
+    const uint16_t copy = available < count - n ? available : count - n;
+    memcpy(samples + n, decoded + frame_position, 2u * copy);
+    frame_position += copy;
+    n += copy;
+  }
+  return n;
+}
@@ -0,0 +1,47 @@
+#ifndef RECORDING_READER_H__
+#define RECORDING_READER_H__
+
+#include <cstdint>
+#include <cstddef>
+
+// reads back recordings written by sdcard.cpp, 16-bit PCM WAV files and
+// lossless .riq files, as interleaved samples. The reader only pulls bytes
+// in order through a callback, so it works the same over FatFs on the
+// receiver and stdio on the host.
+typedef uint32_t (*recording_read_t)(void *context, uint8_t buffer[], uint32_t bytes);
+
+class recording_reader
+{
+  public:
+
+  static const uint16_t max_frame_pairs = 128u;
+
+  bool open(recording_read_t read, void *context);
+  uint16_t read(int16_t samples[], uint16_t count);
+  uint16_t channels() const {return num_channels;}
+  uint32_t sample_rate() const {return rate;}
+
+  private:
+
+  uint32_t fetch(uint8_t buffer[], uint32_t bytes);
+  bool skip(uint32_t bytes);
+  bool open_wav();
+  bool open_riq();
+  bool next_frame();
+
+  recording_read_t read_bytes = NULL;
+  void *context = NULL;
+  bool lossless = false;
+  uint16_t num_channels = 0;
+  uint32_t rate = 0;
+  uint32_t remaining = 0;
+
+  //decoded samples of the current .riq frame
+  uint16_t frame_pairs = 0;
+  uint16_t frame_position = 0;
+  uint16_t frame_samples = 0;
+  int16_t decoded[2 * max_frame_pairs];
+  uint8_t frame[2 + 4 * max_frame_pairs];
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "rice_iq.h"
+
+class bit_writer
+{
+  public:
+
+  bit_writer(uint8_t *output, uint16_t limit) : output(output), limit(limit) {}
+
+  //returns false once the output would exceed the limit
+  bool put(uint32_t value, uint8_t bits)
+  {
+    while(bits)
+    {
+      const uint8_t n = bits > 16 ? 16 : bits;
+      bits -= n;
+      accumulator = (accumulator << n) | ((value >> bits) & ((1u << n) - 1u));
+      pending += n;
+      while(pending >= 8)
+      {
+        if(bytes == limit) return false;
+        pending -= 8;
+        output[bytes++] = accumulator >> pending;
+      }
+    }
+    return true;
+  }
+
+  bool flush()
+  {
+    if(pending) return put(0, 8 - pending);
+    return true;
+  }
+
+  uint16_t size() const {return bytes;}
+
+  private:
+
+  uint8_t *output;
+  uint16_t limit;
+  uint16_t bytes = 0;
+  uint32_t accumulator = 0;
+  uint8_t pending = 0;
+};
+
+class bit_reader
+{
+  public:
+
+  bit_reader(const uint8_t *input, uint16_t limit) : input(input), limit(limit) {}
+
+  //reads past the end return zeros and set overrun
+  uint32_t get(uint8_t bits)
+  {
+    uint32_t value = 0;
+    while(bits--) value = (value << 1) | bit();
+    return value;
+  }
+
+  uint8_t bit()
+  {
+    if(position >= 8u * limit)
+    {
+      overrun = true;
+      return 0;
+    }
+    const uint8_t value = (input[position >> 3] >> (7 - (position & 7))) & 1;
+    ++position;
+    return value;
+  }
+
+  bool overrun = false;
+
+  private:
+
+  const uint8_t *input;
+  uint16_t limit;
+  uint32_t position = 0;
+};
+
+static inline uint32_t zigzag(int32_t x)
+{
+  return ((uint32_t)x << 1) ^ (uint32_t)(x >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u)
+{
+  return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+//prediction residual of the given order (0 to 2) for sample idx, earlier
+//samples that fall before the start of the frame count as zero
+static inline int32_t residual(const int16_t iq[], uint16_t idx, uint8_t order)
+{
+  const int32_t x0 = iq[2 * idx];
+  const int32_t x1 = idx > 0 ? iq[2 * (idx - 1)] : 0;
+  const int32_t x2 = idx > 1 ? iq[2 * (idx - 2)] : 0;
+  if(order == 0) return x0;
+  if(order == 1) return x0 - x1;
+  return x0 - 2 * x1 + x2;
+}
+
+static bool encode_channel(const int16_t iq[], uint16_t pairs, bit_writer &writer)
+{
+  //pick the predictor with the smallest total residual
+  uint32_t totals[3] = {0, 0, 0};
+  for(uint16_t idx = 2; idx < pairs; ++idx)
+  {
+    for(uint8_t order = 0; order < 3; ++order) totals[order] += zigzag(residual(iq, idx, order));
+  }
+  uint8_t order = 0;
+  if(totals[1] < totals[order]) order = 1;
+  if(totals[2] < totals[order]) order = 2;
+
+  //pick k from the mean coded residual, k ~ log2(mean)
+  const uint32_t mean = pairs > 2 ? totals[order] / (pairs - 2) : 0;
+  uint8_t k = 0;
+  while(k < 15 && (mean >> (k + 1))) ++k;
+
+  //the first samples are sent verbatim, up to the predictor order
+  if(!writer.put(order, 2)) return false;
+  if(!writer.put(k, 4)) return false;
+  for(uint16_t idx = 0; idx < pairs; ++idx)
+  {
+    if(idx < order)
+    {
+      if(!writer.put((uint16_t)iq[2 * idx], 16)) return false;
+      continue;
+    }
+    const uint32_t value = zigzag(residual(iq, idx, order));
+    const uint32_t quotient = value >> k;
+    if(quotient < rice_escape)
+    {
+      if(!writer.put((1u << (quotient + 1)) - 2u, quotient + 1)) return false;
+      if(!writer.put(value, k)) return false;
+    }
+    else
+    {
+      if(!writer.put((1u << rice_escape) - 1u, rice_escape)) return false;
+      if(!writer.put(value, 18)) return false;
+    }
+  }
+  return true;
+}
+
+static bool decode_channel(bit_reader &reader, uint16_t pairs, int16_t iq[])
+{
+  const uint8_t order = reader.get(2);
+  const uint8_t k = reader.get(4);
+  if(order > 2) return false;
+  for(uint16_t idx = 0; idx < pairs; ++idx)
+  {
+    if(idx < order)
+    {
+      iq[2 * idx] = (int16_t)reader.get(16);
+      continue;
+    }
+    uint8_t quotient = 0;
+    while(quotient < rice_escape && reader.bit()) ++quotient;
+    const uint32_t value = quotient == rice_escape ? reader.get(18) : ((uint32_t)quotient << k) | reader.get(k);
+    const int32_t x1 = idx > 0 ? iq[2 * (idx - 1)] : 0;
+    const int32_t x2 = idx > 1 ? iq[2 * (idx - 2)] : 0;
+    const int32_t prediction = order == 0 ? 0 : order == 1 ? x1 : 2 * x1 - x2;
+    iq[2 * idx] = prediction + unzigzag(value);
+  }
+  return !reader.overrun;
+}
+
+//decode a whole frame (length word included), returns false if it is malformed
+bool rice_iq_decode(const uint8_t frame[], uint16_t pairs, int16_t iq[])
+{
+  const uint16_t header = frame[0] | (frame[1] << 8);
+  const uint16_t length = header & ~rice_raw_frame;
+  if(header & rice_raw_frame)
+  {
+    if(length != pairs * 4u) return false;
+    for(uint16_t idx = 0; idx < 2 * pairs; ++idx)
+    {
+      iq[idx] = frame[2 + 2 * idx] | (frame[3 + 2 * idx] << 8);
+    }
+    return true;
+  }
+  bit_reader reader(frame + 2, length);
+  return decode_channel(reader, pairs, iq) && decode_channel(reader, pairs, iq + 1);
+}
+
+//returns the number of bytes written to frame, at most rice_iq_max_frame_bytes(pairs)
+uint16_t rice_iq_encode(const int16_t iq[], uint16_t pairs, uint8_t frame[])
+{
+  const uint16_t raw_bytes = pairs * 4u;
+  bit_writer writer(frame + 2, raw_bytes);
+  const bool ok = encode_channel(iq, pairs, writer) &&
+                  encode_channel(iq + 1, pairs, writer) &&
+                  writer.flush();
+
+  uint16_t length = writer.size();
+  uint16_t header = length;
+  if(!ok)
+  {
+    //incompressible, store little endian samples as they are
+    for(uint16_t idx = 0; idx < 2 * pairs; ++idx)
+    {
+      frame[2 + 2 * idx] = iq[idx] & 0xff;
+      frame[3 + 2 * idx] = (uint16_t)iq[idx] >> 8;
+    }
+    length = raw_bytes;
+    header = raw_bytes | rice_raw_frame;
+  }
+  frame[0] = header & 0xff;
+  frame[1] = header >> 8;
+  return length + 2;
+}
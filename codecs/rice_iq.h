@@ -0,0 +1,28 @@
+#ifndef RICE_IQ_H__
+#define RICE_IQ_H__
+
+#include <cstdint>
+
+// lossless IQ encoder, each frame is independently decodable
+//
+// frame: 16-bit little endian length word, bit 15 set for a raw frame
+// followed by length bytes. For each channel (i then q) the bitstream,
+// MSB first, holds the predictor order p (2 bits, 0 to 2), a Rice parameter
+// k (4 bits), the first p samples verbatim (16 bits each) and the zigzag
+// coded prediction residuals of the remaining samples. A residual is sent
+// as q ones, a zero and k low bits, where q is the residual >> k. When q
+// would reach rice_escape the escape code (rice_escape ones) is followed by
+// the 18-bit zigzag value. A frame that would grow is stored raw instead, so
+// the output never exceeds the input by more than the length word.
+static const uint8_t rice_escape = 16u;
+static const uint16_t rice_raw_frame = 0x8000u;
+
+inline uint16_t rice_iq_max_frame_bytes(uint16_t pairs) {return 2u + pairs * 4u;}
+
+//total size of a frame, including the length word
+inline uint16_t rice_iq_frame_bytes(const uint8_t frame[2]) {return 2u + ((frame[0] | (frame[1] << 8)) & ~rice_raw_frame);}
+
+uint16_t rice_iq_encode(const int16_t iq[], uint16_t pairs, uint8_t frame[]);
+bool rice_iq_decode(const uint8_t frame[], uint16_t pairs, int16_t iq[]);
+
+#endif
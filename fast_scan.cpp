@@ -0,0 +1,51 @@
+#include "fast_scan.h"
+#include "cic_corrections.h"
+#include <algorithm>
+
+uint16_t fast_scan_span(uint32_t step_Hz)
+{
+  const uint32_t span_Hz = (uint32_t)fast_scan_max_bin * fast_scan_bin_width_mHz / 1000u;
+  return std::max(span_Hz / step_Hz, (uint32_t)1u);
+}
+
+//signed bin nearest to an offset from the tuned frequency
+static int16_t offset_to_bin(int32_t offset_Hz)
+{
+  const int32_t offset_mHz = offset_Hz * 1000;
+  return (offset_mHz + (offset_mHz < 0 ? -1 : 1) * (int32_t)fast_scan_bin_width_mHz / 2) / (int32_t)fast_scan_bin_width_mHz;
+}
+
+uint16_t fast_scan_find(const int16_t capture[256], int16_t fft_offset, uint32_t step_Hz, int8_t direction, uint16_t channels)
+{
+  //cic corrected magnitude of the usable bins, indexed from -max_bin
+  uint16_t magnitude[2 * fast_scan_max_bin + 1];
+  for(int16_t bin = -fast_scan_max_bin; bin <= fast_scan_max_bin; ++bin)
+  {
+    magnitude[bin + fast_scan_max_bin] = std::max(cic_correct(bin, fft_offset, capture[(uint8_t)bin]), (int16_t)0);
+  }
+
+  remove_dc_spur(magnitude, -fast_scan_max_bin, 2 * fast_scan_max_bin + 1, fft_offset);
+
+  //the median is a noise floor estimate that ignores a few strong signals
+  uint16_t sorted[2 * fast_scan_max_bin + 1];
+  std::copy(magnitude, magnitude + 2 * fast_scan_max_bin + 1, sorted);
+  std::nth_element(sorted, sorted + fast_scan_max_bin, sorted + 2 * fast_scan_max_bin + 1);
+  const uint32_t floor = std::max(sorted[fast_scan_max_bin], (uint16_t)1u);
+
+  //a channel covers the bins within half a step of its centre
+  const int16_t half_width = step_Hz * 500u / fast_scan_bin_width_mHz;
+  for(uint16_t channel = 1; channel <= channels; ++channel)
+  {
+    const int16_t centre = offset_to_bin(direction * (int32_t)(channel * step_Hz));
+    if(centre < -fast_scan_max_bin || centre > fast_scan_max_bin) break;
+    if(centre == 0) continue; //steps smaller than a bin, still on the tuned channel
+    const int16_t first = std::max((int16_t)(centre - half_width), (int16_t)-fast_scan_max_bin);
+    const int16_t last = std::min((int16_t)(centre + half_width), fast_scan_max_bin);
+    uint16_t peak = 0;
+    for(int16_t bin = first; bin <= last; ++bin) peak = std::max(peak, magnitude[bin + fast_scan_max_bin]);
+
+    //10dB is a magnitude ratio of 3.16
+    if((uint32_t)peak * 10u >= floor * 32u) return channel;
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef __fast_scan__
+#define __fast_scan__
+
+#include <cstdint>
+#include "rx_definitions.h"
+
+//The spectrum capture covers +/-15kHz around the tuned frequency, 256 bins
+//of 117Hz. The scanner checks every channel step within the central
+//+/-7.5kHz of one capture, where the cic correction is small, so that the
+//receiver only needs to be retuned once per span instead of once per step.
+static const uint32_t fast_scan_bin_width_mHz = 1000ull * adc_sample_rate / (cic_decimation_rate * 256u);
+static const int16_t fast_scan_max_bin = 64;
+
+//number of channel steps to one side of the tuned frequency covered by a
+//capture, at least 1
+uint16_t fast_scan_span(uint32_t step_Hz);
+
+//returns the first channel (1 to channels) in the given direction whose
+//peak bin is at least 10dB above the median of the capture, 0 if none.
+//fft_offset is the fft_bin returned with the capture, used for cic correction
+uint16_t fast_scan_find(const int16_t capture[256], int16_t fft_offset, uint32_t step_Hz, int8_t direction, uint16_t channels);
+
+#endif
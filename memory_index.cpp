@@ -0,0 +1,107 @@
+#include "memory_index.h"
+#include "memory.h"
+#include "settings.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+struct s_memory_index_entry
+{
+  uint32_t frequency;
+  uint16_t channel;
+};
+
+static uint32_t valid[num_chans/32];
+static s_memory_index_entry by_frequency[num_chans];
+static uint32_t label_key[num_chans];
+static uint16_t count = 0;
+
+//first 4 characters of the label, upper case, packed first character lowest
+static uint32_t make_key(const char *label, uint8_t length)
+{
+  uint32_t key = 0;
+  for(uint8_t idx=0; idx<length; ++idx)
+  {
+    key |= (uint32_t)(uint8_t)toupper(label[idx]) << (8*idx);
+  }
+  return key;
+}
+
+void memory_index_build()
+{
+  memset(valid, 0, sizeof(valid));
+  count = 0;
+  for(uint16_t channel=0; channel<num_chans; ++channel)
+  {
+    const s_memory_channel memory_channel = get_channel(channel);
+    label_key[channel] = make_key(memory_channel.label, 4);
+    if(memory_channel.channel.frequency == 0) continue;
+    valid[channel/32] |= 1u << (channel%32);
+    by_frequency[count++] = {memory_channel.channel.frequency, channel};
+  }
+
+  //ties keep channel number order
+  std::stable_sort(by_frequency, by_frequency + count,
+    [](const s_memory_index_entry &a, const s_memory_index_entry &b){return a.frequency < b.frequency;});
+}
+
+uint16_t memory_index_count()
+{
+  return count;
+}
+
+bool memory_index_valid(uint16_t channel_number)
+{
+  return channel_number < num_chans && (valid[channel_number/32] & (1u << (channel_number%32)));
+}
+
+uint16_t memory_index_next(uint16_t channel_number, int8_t direction)
+{
+  uint16_t channel = channel_number;
+  for(uint16_t idx=1; idx<num_chans; ++idx)
+  {
+    channel = direction > 0 ? (channel == num_chans-1 ? 0 : channel+1) : (channel == 0 ? num_chans-1 : channel-1);
+    if(memory_index_valid(channel)) return channel;
+  }
+  return channel_number;
+}
+
+//binary search for the first entry at or above the frequency, then pick the closer neighbour
+uint16_t memory_index_nearest(uint32_t frequency_Hz)
+{
+  if(count == 0) return memory_index_none;
+  const s_memory_index_entry *upper = std::lower_bound(by_frequency, by_frequency + count, frequency_Hz,
+    [](const s_memory_index_entry &entry, uint32_t frequency){return entry.frequency < frequency;});
+  if(upper == by_frequency) return upper->channel;
+  const s_memory_index_entry *lower = upper - 1;
+  if(upper == by_frequency + count) return lower->channel;
+  return (frequency_Hz - lower->frequency) <= (upper->frequency - frequency_Hz) ? lower->channel : upper->channel;
+}
+
+uint16_t memory_index_search(const char *prefix, uint16_t start_channel)
+{
+  const uint8_t length = strnlen(prefix, 16);
+  const uint8_t key_length = std::min<uint8_t>(length, 4);
+  const uint32_t key = make_key(prefix, key_length);
+  const uint32_t key_mask = key_length == 4 ? 0xffffffffu : (1u << (8*key_length)) - 1u;
+
+  for(uint16_t idx=0; idx<num_chans; ++idx)
+  {
+    const uint16_t channel = (start_channel + idx) % num_chans;
+    if(!memory_index_valid(channel) || (label_key[channel] & key_mask) != key) continue;
+
+    //only prefixes longer than the key need the label from flash
+    if(length > 4)
+    {
+      const s_memory_channel memory_channel = get_channel(channel);
+      bool match = true;
+      for(uint8_t character=4; character<length && match; ++character)
+      {
+        match = toupper(memory_channel.label[character]) == toupper(prefix[character]);
+      }
+      if(!match) continue;
+    }
+    return channel;
+  }
+  return memory_index_none;
+}
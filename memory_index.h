@@ -0,0 +1,28 @@
+#ifndef __memory_index__
+#define __memory_index__
+
+#include <cstdint>
+
+//RAM index of the memory channels, built at boot and rebuilt whenever a
+//sector of channels is programmed. Recall and scanning use it to skip empty
+//channels (frequency 0) without reading each one from flash. The channels
+//are also kept sorted by frequency for nearest channel lookup, along with
+//the first 4 characters of each label for searching.
+static const uint16_t memory_index_none = 0xffffu;
+
+void memory_index_build();
+uint16_t memory_index_count();
+bool memory_index_valid(uint16_t channel_number);
+
+//next non-empty channel in the given direction, wrapping around, returns
+//channel_number if there are no other channels
+uint16_t memory_index_next(uint16_t channel_number, int8_t direction);
+
+//channel with the closest frequency, memory_index_none if there are no channels
+uint16_t memory_index_nearest(uint32_t frequency_Hz);
+
+//first channel from start_channel onwards (wrapping around) whose label
+//starts with prefix, ignoring case, memory_index_none if there is no match
+uint16_t memory_index_search(const char *prefix, uint16_t start_channel);
+
+#endif
@@ -0,0 +1,67 @@
+#!/usr/bin/env python
+
+#bulk memory transfer over the CAT port
+#
+#ZMW<ccc><words>; stages a channel in RAM on the receiver (no reply)
+#ZMC<s><crc>;     programs sector s once if the CRC of the staged image matches,
+#                 replies O; if a front panel store replaced the staged sector
+#ZMR<s>;          streams sector s as 64 ZDN replies followed by ZMR<s><crc>;
+#
+#a sector is 64 channels of 16 words (4096 bytes), there are 8 sectors
+
+import struct
+
+channels_per_sector = 64
+num_sectors = 8
+
+def crc16(data, crc=0xffff):
+  #CRC-16/CCITT, as crc16() in utils.cpp
+  for byte in data:
+    crc ^= byte << 8
+    for bit in range(8):
+      crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+      crc &= 0xffff
+  return crc
+
+def sector_crc(channels):
+  return crc16(b"".join(struct.pack("<16I", *channel) for channel in channels))
+
+def read_reply(ser):
+  reply = b""
+  while not reply.endswith(b";"):
+    data = ser.read(1)
+    if not data:
+      raise IOError("no reply from receiver")
+    reply += data
+  return reply.decode("utf8")
+
+def read_sector(ser, sector):
+  ser.write(bytes("ZMR%x;"%sector, "utf8"))
+  channels = []
+  for channel_number in range(sector*channels_per_sector, (sector+1)*channels_per_sector):
+    reply = read_reply(ser)
+    if reply[:6] != "ZDN%03x"%channel_number:
+      raise IOError("unexpected reply %s"%reply[:8])
+    channels.append([int(reply[6+i*8:14+i*8], 16) for i in range(16)])
+  reply = read_reply(ser)
+  if reply != "ZMR%x%04x;"%(sector, sector_crc(channels)):
+    raise IOError("CRC error reading sector %u"%sector)
+  return channels
+
+class SectorInterrupted(IOError):
+  #a memory store from the front panel replaced the staged sector
+  pass
+
+def write_sector(ser, sector, channels):
+  cmd = ""
+  for offset, channel in enumerate(channels):
+    cmd += "ZMW%03x"%(sector*channels_per_sector + offset)
+    cmd += "".join("%08x"%word for word in channel)
+    cmd += ";"
+  cmd += "ZMC%x%04x;"%(sector, sector_crc(channels))
+  ser.write(bytes(cmd, "utf8"))
+  reply = read_reply(ser)
+  if reply == "O;":
+    raise SectorInterrupted("sector %u was changed on the receiver while uploading"%sector)
+  if reply != "ZMC%x;"%sector:
+    raise IOError("sector %u was not written"%sector)
@@ -5,6 +5,7 @@ import struct
 import os
 import time
 from channel_to_words import words_to_channel
+from bulk_memory import num_sectors, read_sector
 
 
 if len(sys.argv) < 2 or "-h" in sys.argv or "--help" in sys.argv:
@@ -54,14 +55,11 @@ with serial.Serial(port, 12000000, rtscts=1, timeout=1) as ser:
 
     with open(filename, 'w') as output_file:
       output_file.write("Title           , Frequency, Band Start, Band End, Mode, AGC Speed, Frequency Step, bandwdth\n")
-      for channel_number in range(512):
-        print("Fetching Channel:", channel_number)
-        cmd = "ZDN%03x;"%(channel_number)
-        ser.write(bytes(cmd, "utf8"))
-        data = ser.read(135)
-        data = data[6:].decode("utf8")
-        data = [int(data[i*8:i*8+8], 16) for i in range(16)]
-        name, frequency, min_frequency, max_frequency, mode, agc_speed, step, bandwidth = words_to_channel(data)
-        csvline = "%s %u %u %u %s %s %s %s\n"%(name, frequency, min_frequency, max_frequency, mode, agc_speed, step, bandwidth)
-        output_file.write(csvline)
-
+      start = time.time()
+      for sector in range(num_sectors):
+        print("Fetching Sector:", sector)
+        for data in read_sector(ser, sector):
+          name, frequency, min_frequency, max_frequency, mode, agc_speed, step, bandwidth = words_to_channel(data)
+          csvline = "%s %u %u %u %s %s %s %s\n"%(name, frequency, min_frequency, max_frequency, mode, agc_speed, step, bandwidth)
+          output_file.write(csvline)
+      print("Downloaded %u sectors in %.2f s"%(num_sectors, time.time() - start))
@@ -4,6 +4,7 @@ import serial.tools.list_ports
 import struct
 import time
 from channel_to_words import channel_to_words
+from bulk_memory import channels_per_sector, read_sector, write_sector, SectorInterrupted
 
 
 def read_csv(filename):
@@ -69,14 +70,25 @@ with serial.Serial(port, 12000000, rtscts=1, timeout=1) as ser:
     while ser.in_waiting:
       ser.read(ser.in_waiting)
 
-    with open(filename, 'rb') as input_file:
-      for channel_number, channel in enumerate(buffer):
-        print("Uploading channel:", channel_number)
-        cmd = "ZUP%03x"%channel_number
-        for location in channel:
-          cmd += "%08x"%location
-        cmd += ";"
-        #print(cmd, len(cmd))
-        ser.write(bytes(cmd, "utf8"))
-        ser.read(7)
-
+    #each sector is staged on the receiver and programmed once, a sector
+    #that is only partly covered by the file is read back first so that
+    #the channels after the end of the file are left unchanged
+    start = time.time()
+    sectors_written = 0
+    #a sector is sent again if a channel was stored from the front panel
+    #part way through, re-reading any channels that are kept
+    for sector in range((len(buffer) + channels_per_sector - 1)//channels_per_sector):
+      for attempt in range(3):
+        channels = buffer[sector*channels_per_sector:(sector+1)*channels_per_sector]
+        if len(channels) < channels_per_sector:
+          channels += read_sector(ser, sector)[len(channels):]
+        print("Uploading sector:", sector)
+        try:
+          write_sector(ser, sector, channels)
+          break
+        except SectorInterrupted as e:
+          print(e)
+      else:
+        raise IOError("sector %u was not written"%sector)
+      sectors_written += 1
+    print("Uploaded %u channels in %.2f s, %u sector writes"%(len(buffer), time.time() - start, sectors_written))
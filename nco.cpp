@@ -7,67 +7,35 @@
 #include <cmath>
 #include <cstdio>
 
-float nco_set_frequency(PIO pio, uint sm, float tuned_frequency, uint32_t &system_clock_frequency_out, uint8_t if_frequency_hz_over_100, uint8_t if_mode) {
+//index of the system clock in use, not known until it is first set
+static int16_t active_pll = -1;
 
-    double adjusted_frequency_up = tuned_frequency + (if_frequency_hz_over_100*100);
-    double adjusted_frequency_down = tuned_frequency - (if_frequency_hz_over_100*100);
-    PLLSettings best_settings = {0, 0, 0, 0, 0};
-    double best_frequency = 1.0;
-    double best_divider = 0.0;
-    double best_error = 1000000.0;
+s_nco_plan nco_plan(double tuned_frequency, uint8_t if_frequency_hz_over_100, uint8_t if_mode) {
+    return nco_plan_frequency(tuned_frequency, if_frequency_hz_over_100, if_mode, active_pll);
+}
 
-    for(uint8_t idx = 0; idx < num_possible_frequencies; idx++)
-    {
+bool nco_plan_changes_pll(const s_nco_plan &plan) {
+    return plan.pll != active_pll;
+}
 
-      uint32_t system_clock_frequency = possible_frequencies[idx].frequency;
-      double ideal_divider;
-      double nearest_divider;
-      double actual_frequency;
-      double error;
+void nco_set_system_clock(uint8_t pll, uint32_t &system_clock_frequency_out) {
+    const PLLSettings &settings = possible_frequencies[pll];
+    system_clock_frequency_out = settings.frequency;
+    if(pll == active_pll) return;
 
-      //upper or nearest
-      if(if_mode == 1 || if_mode == 2)
-      {
-        ideal_divider = system_clock_frequency/(4.0*adjusted_frequency_up);
-        nearest_divider = round(256.0*ideal_divider)/256.0;
-        actual_frequency = system_clock_frequency/nearest_divider;
-        error = abs(actual_frequency - 4.0*adjusted_frequency_up);
-        if(error < best_error)
-        {
-          best_frequency = actual_frequency;
-          best_settings = possible_frequencies[idx];
-          best_divider = nearest_divider;
-          best_error = error;
-          system_clock_frequency_out = system_clock_frequency;
-        }
-      }
+    //adjust system clock
+    uint32_t vco_freq = (12000000 / settings.refdiv) * settings.fbdiv;
+    set_sys_clock_pll(vco_freq, settings.postdiv1, settings.postdiv2);
+    active_pll = pll;
+}
 
-      //lower or nearest
-      if(if_mode == 0 || if_mode == 2)
-      {
-        ideal_divider = system_clock_frequency/(4.0*adjusted_frequency_down);
-        nearest_divider = round(256.0*ideal_divider)/256.0;
-        actual_frequency = system_clock_frequency/nearest_divider;
-        error = abs(actual_frequency - 4.0*adjusted_frequency_down);
-        if(error < best_error)
-        {
-          best_frequency = actual_frequency;
-          best_settings = possible_frequencies[idx];
-          best_divider = nearest_divider;
-          best_error = error;
-          system_clock_frequency_out = system_clock_frequency;
-        }
-      }
-    }
+double nco_apply_plan(PIO pio, uint sm, const s_nco_plan &plan, uint32_t &system_clock_frequency_out) {
 
-    assert(best_error < 1000000);
-    //adjust system clock
-    uint32_t vco_freq = (12000000 / best_settings.refdiv) * best_settings.fbdiv;
-    set_sys_clock_pll(vco_freq, best_settings.postdiv1, best_settings.postdiv2);
+    nco_set_system_clock(plan.pll, system_clock_frequency_out);
 
     //set pio divider
-    pio_sm_set_clkdiv(pio, sm, best_divider);
+    pio_sm_set_clkdiv(pio, sm, plan.divider / 256.0f);
 
     //return actual frequency
-    return best_frequency/4.0;
+    return plan.frequency_Hz;
 }
@@ -1,7 +1,15 @@
 #ifndef NCO_H_
 #define NCO_H_
 #include "hardware/pio.h"
+#include "nco_plan.h"
 
-float nco_set_frequency(PIO pio, uint sm, float tuned_frequency, uint32_t &system_clock_frequency_out, uint8_t if_frequency_hz_over_100, uint8_t if_mode);
+//plans a retune from the system clock currently in use
+s_nco_plan nco_plan(double tuned_frequency, uint8_t if_frequency_hz_over_100, uint8_t if_mode);
+
+//true if applying the plan would reprogram the PLL
+bool nco_plan_changes_pll(const s_nco_plan &plan);
+
+double nco_apply_plan(PIO pio, uint sm, const s_nco_plan &plan, uint32_t &system_clock_frequency_out);
+void nco_set_system_clock(uint8_t pll, uint32_t &system_clock_frequency_out);
 
 #endif
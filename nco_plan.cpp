@@ -0,0 +1,77 @@
+#include "nco_plan.h"
+#include "clocks.h"
+
+#include <algorithm>
+#include <cmath>
+
+//nearest divider for one system clock, the error is in 1/16ths of a Hz at
+//4x the nco frequency (the pio program takes 4 clocks per cycle)
+static uint32_t divider_error(uint32_t system_clock_frequency, uint32_t target_Hz, uint32_t &divider)
+{
+  divider = ((uint64_t)system_clock_frequency * 256u + target_Hz / 2u) / target_Hz;
+  const uint64_t actual = ((uint64_t)system_clock_frequency * 4096u) / divider;
+  const uint64_t target = (uint64_t)target_Hz * 16u;
+  return actual > target ? actual - target : target - actual;
+}
+
+//best side for one system clock, if_mode 0 = lower, 1 = upper, 2 = nearest
+static uint32_t best_for_pll(uint8_t pll, uint32_t up_Hz, uint32_t down_Hz, uint8_t if_mode, uint32_t &divider)
+{
+  uint32_t best_error = UINT32_MAX;
+  uint32_t side_divider;
+  if(if_mode == 1 || if_mode == 2)
+  {
+    best_error = divider_error(possible_frequencies[pll].frequency, up_Hz, divider);
+  }
+  if(if_mode == 0 || if_mode == 2)
+  {
+    const uint32_t error = divider_error(possible_frequencies[pll].frequency, down_Hz, side_divider);
+    if(error < best_error)
+    {
+      best_error = error;
+      divider = side_divider;
+    }
+  }
+  return best_error;
+}
+
+//keeps the LO at least 3/4 of the IF away from the wanted signal
+uint32_t nco_hold_error(uint8_t if_frequency_hz_over_100)
+{
+  const uint32_t if_Hz = if_frequency_hz_over_100 * 100u;
+  return if_Hz ? std::min(nco_hold_error_Hz, if_Hz / 4u) : nco_hold_error_Hz;
+}
+
+s_nco_plan nco_plan_frequency(double tuned_frequency, uint8_t if_frequency_hz_over_100, uint8_t if_mode, int16_t active_pll)
+{
+  const uint32_t up_Hz = std::max(lround(4.0 * (tuned_frequency + (if_frequency_hz_over_100*100))), 1l);
+  const uint32_t down_Hz = std::max(lround(4.0 * (tuned_frequency - (if_frequency_hz_over_100*100))), 1l);
+
+  s_nco_plan plan = {0, 0, 0.0};
+  uint32_t divider;
+
+  //stay on the current system clock if it is close enough
+  if(active_pll >= 0 && active_pll < num_possible_frequencies &&
+     best_for_pll(active_pll, up_Hz, down_Hz, if_mode, divider) <= 4u * 16u * nco_hold_error(if_frequency_hz_over_100))
+  {
+    plan.pll = active_pll;
+    plan.divider = divider;
+  }
+  else
+  {
+    uint32_t best_error = UINT32_MAX;
+    for(uint8_t idx = 0; idx < num_possible_frequencies; idx++)
+    {
+      const uint32_t error = best_for_pll(idx, up_Hz, down_Hz, if_mode, divider);
+      if(error < best_error)
+      {
+        best_error = error;
+        plan.pll = idx;
+        plan.divider = divider;
+      }
+    }
+  }
+
+  plan.frequency_Hz = possible_frequencies[plan.pll].frequency * 256.0 / (4.0 * plan.divider);
+  return plan;
+}
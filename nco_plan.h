@@ -0,0 +1,26 @@
+#ifndef NCO_PLAN_H_
+#define NCO_PLAN_H_
+
+#include <cstdint>
+
+//A tuning plan is a system clock (one of possible_frequencies) and a PIO
+//divider in 1/256ths that together give the NCO frequency. Plans are made
+//in integer arithmetic. The system clock in use is kept while it can reach
+//the requested frequency within nco_hold_error_Hz, so the PLL, PWM and USB
+//timing are only disturbed when a different clock is needed. The error eats
+//into the IF, so with an IF it is also limited to a quarter of the IF.
+static const uint32_t nco_hold_error_Hz = 2000u;
+
+struct s_nco_plan
+{
+  uint8_t pll;
+  uint32_t divider;
+  double frequency_Hz;
+};
+
+uint32_t nco_hold_error(uint8_t if_frequency_hz_over_100);
+
+//active_pll is the index of the system clock in use, or -1 if not known
+s_nco_plan nco_plan_frequency(double tuned_frequency, uint8_t if_frequency_hz_over_100, uint8_t if_mode, int16_t active_pll);
+
+#endif
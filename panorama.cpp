@@ -0,0 +1,204 @@
+#include "panorama.h"
+#include "cic_corrections.h"
+#include "pico/stdlib.h"
+#include <algorithm>
+#include <cmath>
+
+static const int16_t segment_first_bin = panorama_segment_first_bin;
+static const uint16_t segment_bins = panorama_segment_bins;
+static const uint32_t bin_width_mHz = panorama_bin_width_mHz;
+
+static rx *receiver = NULL;
+static rx_settings *settings_to_apply = NULL;
+static bool active = false;
+static s_panorama_status status;
+static s_panorama_status sweep_status;
+static s_panorama_band bands[panorama_max_bands];
+static uint8_t num_bands = 0;
+static uint32_t retune_time_us = 0;
+static uint32_t sweep_start_us = 0;
+
+//peak magnitude of each pixel, pixels keep the previous sweep until overwritten
+static uint16_t level[panorama_pixels];
+static uint16_t level_sweep[panorama_pixels];
+static uint16_t sweep = 0;
+
+static uint32_t segment_frequency(uint16_t segment)
+{
+  return status.start_Hz + ((uint64_t)(segment * segment_bins - segment_first_bin) * bin_width_mHz) / 1000u;
+}
+
+static void retune(uint16_t segment)
+{
+  receiver->access(true);
+  settings_to_apply->tuned_frequency_Hz = segment_frequency(segment);
+  receiver->release();
+  retune_time_us = time_us_32();
+}
+
+static void set_band(uint8_t band)
+{
+  status.band = band;
+  status.start_Hz = std::min(bands[band].start_Hz, bands[band].stop_Hz);
+  status.stop_Hz = std::max(bands[band].start_Hz, bands[band].stop_Hz);
+  if(status.stop_Hz == status.start_Hz) status.stop_Hz += 1000u;
+  const uint64_t segment_width_mHz = (uint64_t)segment_bins * bin_width_mHz;
+  status.segments = ((uint64_t)(status.stop_Hz - status.start_Hz) * 1000u + segment_width_mHz - 1) / segment_width_mHz;
+  status.segment = 0;
+}
+
+void panorama_start(rx &rx_inst, rx_settings &rx_settings, const s_panorama_band band_list[], uint8_t band_count, uint16_t settle_ms, uint16_t dwell_ms)
+{
+  receiver = &rx_inst;
+  settings_to_apply = &rx_settings;
+  num_bands = std::max<uint8_t>(std::min(band_count, panorama_max_bands), 1u);
+  std::copy(band_list, band_list + num_bands, bands);
+  set_band(0);
+  status.settle_ms = settle_ms;
+  status.dwell_ms = dwell_ms;
+  status.sweep_ms = 0;
+  status.rate_kHz_per_s = 0;
+  sweep_status = status;
+  std::fill(level, level + panorama_pixels, 0);
+  std::fill(level_sweep, level_sweep + panorama_pixels, 0);
+  sweep = 1;
+
+  //the sweep is not for listening
+  receiver->access(true);
+  settings_to_apply->volume = 0;
+  receiver->release();
+
+  active = true;
+  sweep_start_us = time_us_32();
+  retune(0);
+}
+
+//the caller restores the receiver settings
+void panorama_stop()
+{
+  active = false;
+}
+
+bool panorama_active()
+{
+  return active;
+}
+
+//a bin covers every pixel it overlaps, a pixel takes the peak of its bins
+static void stitch(const uint16_t magnitude[], const s_panorama_status &captured)
+{
+  //pixels of another band are not kept
+  if(captured.segment == 0 && num_bands > 1) std::fill(level, level + panorama_pixels, 0);
+  const uint64_t range_mHz = (uint64_t)(captured.stop_Hz - captured.start_Hz) * 1000u;
+  for(uint16_t bin = 0; bin < segment_bins; ++bin)
+  {
+    const uint64_t offset_mHz = (uint64_t)(captured.segment * segment_bins + bin) * bin_width_mHz;
+    if(offset_mHz >= range_mHz) break;
+    const uint16_t first = offset_mHz * panorama_pixels / range_mHz;
+    const uint16_t last = std::min<uint64_t>(((offset_mHz + bin_width_mHz) * panorama_pixels - 1) / range_mHz, panorama_pixels - 1);
+    for(uint16_t pixel = first; pixel <= last; ++pixel)
+    {
+      if(level_sweep[pixel] != sweep)
+      {
+        level_sweep[pixel] = sweep;
+        level[pixel] = magnitude[bin];
+      }
+      else
+      {
+        level[pixel] = std::max(level[pixel], magnitude[bin]);
+      }
+    }
+  }
+}
+
+bool panorama_task()
+{
+  if(!active) return false;
+  if(time_us_32() - retune_time_us < 1000u * (status.settle_ms + status.dwell_ms)) return false;
+
+  int16_t fft_bin;
+  uint16_t magnitude[segment_bins];
+  if(!panorama_capture_levels(*receiver, magnitude, fft_bin)) return false;
+
+  //start the next retune before stitching, so the two overlap
+  const s_panorama_status captured = status;
+  if(++status.segment == status.segments)
+  {
+    const uint32_t now = time_us_32();
+    status.sweep_ms = std::max<uint32_t>((now - sweep_start_us) / 1000u, 1u);
+    status.rate_kHz_per_s = (uint64_t)(status.stop_Hz - status.start_Hz) * 1000u / status.sweep_ms / 1000u;
+    sweep_start_us = now;
+    sweep_status = status;
+    set_band((status.band + 1) % num_bands);
+  }
+  retune(status.segment);
+
+  stitch(magnitude, captured);
+  if(status.segment != 0) return false;
+  sweep = sweep == UINT16_MAX ? 1 : sweep + 1;
+  return true;
+}
+
+bool panorama_capture_levels(rx &rx_inst, uint16_t magnitude[panorama_segment_bins], int16_t &fft_bin)
+{
+  const int16_t *capture = rx_inst.rx_dsp_inst.try_acquire_capture(fft_bin);
+  if(!capture) return false;
+  for(uint16_t idx = 0; idx < segment_bins; ++idx)
+  {
+    const int16_t bin = segment_first_bin + idx;
+    magnitude[idx] = std::max(cic_correct(bin, fft_bin, capture[(uint8_t)bin]), (int16_t)1); //0 marks an unswept pixel
+  }
+  rx_inst.rx_dsp_inst.release_capture();
+  remove_dc_spur(magnitude, segment_first_bin, segment_bins, fft_bin);
+  return true;
+}
+
+const uint16_t *panorama_levels()
+{
+  return level;
+}
+
+void panorama_get_spectrum(uint8_t spectrum[], uint8_t &dB10)
+{
+  const uint16_t lowest_max = 2500u;
+  uint16_t max = 0u;
+  uint16_t min = 65535u;
+  for(uint16_t pixel = 0; pixel < panorama_pixels; ++pixel)
+  {
+    if(level[pixel] == 0) continue;
+    max = std::max(level[pixel], max);
+    min = std::min(level[pixel], min);
+  }
+  if(max == 0) min = 1;
+  const float logmin = log10f(min);
+  const float logmax = log10f(std::max(max, lowest_max));
+
+  for(uint16_t pixel = 0; pixel < panorama_pixels; ++pixel)
+  {
+    if(level[pixel] == 0)
+    {
+      spectrum[pixel] = 0u;
+    } else {
+      const float normalised = 255.0f*(log10f(level[pixel])-logmin)/(logmax-logmin);
+      spectrum[pixel] = std::max(std::min(normalised, 255.0f), 0.0f);
+    }
+  }
+
+  //number steps representing 10dB, as rx_dsp::get_spectrum
+  dB10 = 256/(2*logf((float)std::max(max, lowest_max)/min));
+}
+
+uint32_t panorama_pixel_frequency(uint16_t pixel)
+{
+  return status.start_Hz + (uint64_t)(status.stop_Hz - status.start_Hz) * (2u * pixel + 1u) / (2u * panorama_pixels);
+}
+
+s_panorama_status panorama_status()
+{
+  return status;
+}
+
+s_panorama_status panorama_sweep_status()
+{
+  return sweep_status;
+}
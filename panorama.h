@@ -0,0 +1,70 @@
+#ifndef __panorama__
+#define __panorama__
+
+#include <cstdint>
+#include "rx.h"
+
+//Panorama sweep
+//
+//The receiver is stepped across a frequency range one segment at a time. A
+//segment is the central 120 bins (14.06kHz) of the spectrum capture, the
+//outer bins are dropped because of cic droop and leakage from signals just
+//outside the capture. Each segment's capture is taken once the retune has
+//settled and the capture has averaged for the dwell time, the next retune
+//is started straight away and the segment is stitched into a 256 pixel
+//panorama while the receiver settles on the next one.
+//
+//Several bands can be given, the sweep moves on to the next band each time
+//one completes. The SD survey uses this to log a list of bands.
+static const uint16_t panorama_pixels = 256u;
+static const uint8_t panorama_max_bands = 4u;
+
+//central bins of a capture used for a segment, and by the live survey
+static const int16_t panorama_segment_first_bin = -60;
+static const uint16_t panorama_segment_bins = 120u;
+static const uint32_t panorama_bin_width_mHz = 1000ull * adc_sample_rate / (cic_decimation_rate * 256u);
+
+struct s_panorama_band
+{
+  uint32_t start_Hz;
+  uint32_t stop_Hz;
+};
+
+struct s_panorama_status
+{
+  uint8_t band;
+  uint32_t start_Hz;
+  uint32_t stop_Hz;
+  uint16_t segments;
+  uint16_t segment;
+  uint16_t settle_ms;
+  uint16_t dwell_ms;
+  uint32_t sweep_ms;      //duration of the last complete sweep, 0 until one completes
+  uint32_t rate_kHz_per_s; //sweep rate of the last complete sweep
+};
+
+void panorama_start(rx &receiver, rx_settings &settings_to_apply, const s_panorama_band bands[], uint8_t num_bands, uint16_t settle_ms, uint16_t dwell_ms);
+void panorama_stop();
+bool panorama_active();
+
+//call often from the main loop, retunes the receiver when a segment is captured
+//and returns true when a sweep completes
+bool panorama_task();
+
+//cic corrected magnitude of each pixel, a whole sweep when panorama_task returns true
+const uint16_t *panorama_levels();
+
+//the band of the sweep that panorama_task last completed, the status has
+//already moved on to the next band
+s_panorama_status panorama_sweep_status();
+
+//cic corrected magnitude of the segment bins of the current capture with the
+//DC spur removed, false if core 1 is updating the capture
+bool panorama_capture_levels(rx &receiver, uint16_t magnitude[panorama_segment_bins], int16_t &fft_bin);
+
+//log scaled like rx::get_spectrum so the same displays can draw it
+void panorama_get_spectrum(uint8_t spectrum[], uint8_t &dB10);
+uint32_t panorama_pixel_frequency(uint16_t pixel);
+s_panorama_status panorama_status();
+
+#endif
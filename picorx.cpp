@@ -12,6 +12,8 @@
 #include "cat.h"
 #include "stack_watermark.h"
 #include "sdcard.h"
+#include "panorama.h"
+#include "usb_serial.h"
 
 #define UI_REFRESH_HZ (10UL)
 #define UI_REFRESH_US (1000000UL / UI_REFRESH_HZ)
@@ -19,6 +21,8 @@
 #define BUTTONS_REFRESH_US (50000UL) // 50ms <=> 20Hz
 #define WATERFALL_REFRESH_US (50000UL) // 50ms <=> 20Hz
 #define STACK_UPDATE_US (1000000UL) // 1s
+#define TELEMETRY_REFRESH_US (100000UL) // 100ms <=> 10Hz
+#define SURVEY_LIVE_REFRESH_US (100000UL) // 100ms <=> 10Hz
 
 uint8_t spectrum[256];
 uint8_t audio[128];
@@ -30,6 +34,72 @@ static rx receiver(settings_to_apply, status);
 static waterfall waterfall_inst(receiver);
 static ui user_interface(settings_to_apply, status, receiver, spectrum, audio, dB10, zoom, waterfall_inst);
 
+//hang time after the squelch closes before a squelch gated recording ends a file
+static uint16_t sd_card_squelch_hang_ms(uint8_t setting)
+{
+  static const uint16_t hang_ms[] = {0, 1000, 2000, 5000, 10000, 30000};
+  return setting < sizeof(hang_ms)/sizeof(hang_ms[0]) ? hang_ms[setting] : 0;
+}
+
+static uint16_t survey_interval_s(uint8_t setting)
+{
+  static const uint16_t interval_s[] = {0, 60, 300, 900, 3600};
+  return setting < sizeof(interval_s)/sizeof(interval_s[0]) ? interval_s[setting] : 0;
+}
+
+//a completed panorama sweep, one band of the survey
+static void survey_panorama_sweep()
+{
+  const s_panorama_status sweep = panorama_sweep_status();
+  const s_survey_range range = {sweep.band, 0, 0, sweep.start_Hz, sweep.stop_Hz};
+  sdcard_survey_sweep(range, panorama_levels(), panorama_pixels);
+}
+
+//while listening, the central bins of the spectrum capture are logged around
+//the tuned frequency. Core 1 skips a capture update while core 0 holds the
+//capture, so the audio is not affected. A retune is left to settle first.
+static void survey_live(uint16_t settle_ms)
+{
+  static uint32_t tuned_Hz = 0;
+  static uint32_t retune_time_us = 0;
+  static uint32_t last_capture_us = 0;
+  const uint32_t now = time_us_32();
+  if((uint32_t)settings_to_apply.tuned_frequency_Hz != tuned_Hz)
+  {
+    tuned_Hz = settings_to_apply.tuned_frequency_Hz;
+    retune_time_us = now;
+  }
+  if(now - retune_time_us < 1000u * settle_ms || now - last_capture_us < SURVEY_LIVE_REFRESH_US) return;
+
+  int16_t fft_bin;
+  uint16_t level[panorama_segment_bins];
+  if(!panorama_capture_levels(receiver, level, fft_bin)) return;
+  last_capture_us = now;
+
+  //bin n is centred on tuned_Hz + n bin widths
+  const int64_t start_mHz = 1000ll * tuned_Hz + (2 * panorama_segment_first_bin - 1) * (int64_t)panorama_bin_width_mHz / 2;
+  const s_survey_range range = {SD_SURVEY_LIVE_BAND, fft_bin, tuned_Hz, (uint32_t)(start_mHz / 1000),
+                                (uint32_t)((start_mHz + (int64_t)panorama_segment_bins * panorama_bin_width_mHz) / 1000)};
+  sdcard_survey_sweep(range, level, panorama_segment_bins);
+}
+
+//one CSV line per update on the telemetry port:
+//time_ms,signal_dBm,battery,temp,busy_us,audio_fill,audio_underruns,adc_overruns,dropped_blocks,usb_rate_ppm,cat_dropped_bytes,save_suspend_us,retune_us,pll_changes,audio_rate_ppm
+static void send_telemetry()
+{
+  if(!usb_serial_connected(USB_SERIAL_TELEMETRY)) return;
+  receiver.access(false);
+  const rx_status snapshot = status;
+  status.retune_us = 0;
+  receiver.release();
+  usb_serial_printf(USB_SERIAL_TELEMETRY, "%lu,%ld,%u,%u,%lu,%u,%lu,%lu,%lu,%d,%lu,%lu,%lu,%lu,%d\r\n",
+    time_us_32()/1000, snapshot.signal_strength_dBm, snapshot.battery, snapshot.temp,
+    snapshot.busy_time, snapshot.audio_fill, snapshot.audio_underruns, snapshot.adc_overruns,
+    snapshot.dropped_blocks, snapshot.usb_rate_ppm, usb_serial_dropped_bytes(USB_SERIAL_CAT),
+    autosave_worst_suspend_us(), snapshot.retune_us, snapshot.pll_changes,
+    snapshot.audio_rate_ppm);
+}
+
 void core1_main()
 {
     multicore_lockout_victim_init();
@@ -68,13 +138,26 @@ int main()
   uint32_t last_buttons_update = 0;
   uint32_t last_waterfall_update = 0;
   uint32_t last_stack_update = 0;
+  uint32_t last_telemetry_update = 0;
 
   s_settings s = user_interface.get_settings();
-  bool sd_card_save = s.global.sd_card_save;
+  uint8_t sd_card_save = s.global.sd_card_save;
   if (sd_card_save) {
-    const uint32_t c = sdcard_start_recording(s.channel.frequency, s.channel.mode);
+    const uint32_t c = sdcard_start_recording(s.channel.frequency, s.channel.mode, sd_card_save,
+                                              sd_card_squelch_hang_ms(s.global.sd_card_squelch));
     user_interface.update_sdcard_counter(c);
   }
+  uint32_t sd_card_playback = 0;
+
+  // the time-shift ring runs whenever nothing is being recorded or played
+  uint8_t sd_card_timeshift = s.global.sd_card_timeshift;
+  uint8_t timeshift_minutes = s.global.sd_card_timeshift_minutes;
+  sdcard_start_timeshift(sd_card_timeshift, timeshift_minutes);
+
+  // while the survey is enabled the live spectrum is logged to the sd card,
+  // or the panorama sweeps when the panorama view is open
+  uint8_t survey_setting = 0;
+  bool survey = false;
 
   while(1)
   {
@@ -88,22 +171,69 @@ int main()
       user_interface.update_buttons();
     }
     receiver.tune();
+    if (panorama_task()) {
+      if (survey) survey_panorama_sweep();
+    } else if (survey && !panorama_active() && !sd_card_playback) {
+      survey_live(s.global.panorama_settle_ms + s.global.panorama_dwell_ms);
+    }
 
     if(time_us_32() - last_ui_update > UI_REFRESH_US)
     {
       last_ui_update = time_us_32();
       user_interface.do_ui();
       s = user_interface.get_settings();
+      sdcard_set_channel(s.channel.frequency, s.channel.mode, status.signal_strength_dBm);
+      if (sd_card_save) {
+        // squelch gated recordings number each file as it opens
+        user_interface.update_sdcard_counter(sdcard_get_counter());
+      }
       if (sd_card_save != s.global.sd_card_save) {
         sd_card_save = s.global.sd_card_save;
         if (sd_card_save) {
-          const uint32_t c = sdcard_start_recording(s.channel.frequency, s.channel.mode);
+          const uint32_t c = sdcard_start_recording(s.channel.frequency, s.channel.mode, sd_card_save,
+                                                    sd_card_squelch_hang_ms(s.global.sd_card_squelch));
           user_interface.update_sdcard_counter(c);
         } else {
           sdcard_stop_recording();
+          sdcard_start_timeshift(sd_card_timeshift, timeshift_minutes);
         }
       }
-      receiver.get_spectrum(spectrum, dB10, zoom);
+      if (sd_card_timeshift != s.global.sd_card_timeshift ||
+          timeshift_minutes != s.global.sd_card_timeshift_minutes) {
+        sd_card_timeshift = s.global.sd_card_timeshift;
+        timeshift_minutes = s.global.sd_card_timeshift_minutes;
+        if (!sd_card_save && !sd_card_playback) {
+          sdcard_start_timeshift(sd_card_timeshift, timeshift_minutes);
+        }
+      }
+      if (sd_card_playback != user_interface.get_sdcard_playback()) {
+        sd_card_playback = user_interface.get_sdcard_playback();
+        uint32_t frequency = 0;
+        if (sd_card_playback && sdcard_start_playback(sd_card_playback, frequency)) {
+          // start tuned to the recorded frequency, tuning shifts within the recording
+          receiver.set_playback(true, frequency);
+          user_interface.get_settings().channel.frequency = frequency;
+          apply_settings_to_rx(receiver, settings_to_apply, user_interface.get_settings(), false, true);
+        } else {
+          sdcard_stop_playback();
+          user_interface.stop_sdcard_playback();
+          sd_card_playback = 0;
+          receiver.set_playback(false, 0);
+          if (!sd_card_save) {
+            sdcard_start_timeshift(sd_card_timeshift, timeshift_minutes);
+          }
+        }
+      }
+      if (survey_setting != s.global.sd_card_survey) {
+        survey_setting = s.global.sd_card_survey;
+        sdcard_stop_survey();
+        survey = survey_interval_s(survey_setting) && sdcard_start_survey(survey_interval_s(survey_setting));
+      }
+      if (panorama_active()) {
+        panorama_get_spectrum(spectrum, dB10);
+      } else {
+        receiver.get_spectrum(spectrum, dB10, zoom);
+      }
       receiver.get_audio(audio);
     }
 
@@ -119,6 +249,12 @@ int main()
       waterfall_inst.update(user_interface.get_settings(), settings_to_apply, status, spectrum, dB10, zoom);
     }
 
+    if(time_us_32() - last_telemetry_update > TELEMETRY_REFRESH_US)
+    {
+      last_telemetry_update = time_us_32();
+      send_telemetry();
+    }
+
     if(time_us_32() - last_stack_update > STACK_UPDATE_US)
     {
       last_stack_update = time_us_32();
@@ -127,10 +263,15 @@ int main()
       #endif
     }
 
-    if (sd_card_save) {
+    if (sd_card_save || sd_card_timeshift) {
       if (sdcard_needs_flush()) {
         sdcard_flush();
       }
     }
+    if (sd_card_playback) {
+      if (sdcard_needs_fill()) {
+        sdcard_fill();
+      }
+    }
   }
 }
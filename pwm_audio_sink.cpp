@@ -8,55 +8,150 @@
 #include "pico/sync.h"
 
 #include <cstdio>
+#include <cstring>
 
 
 #define NUM_OUT_SAMPLES (PWM_AUDIO_NUM_SAMPLES * interpolation_rate)
 
 static int audio_pwm_slice_num;
-static int pwm_dma_ping;
-static int pwm_dma_pong;
-static dma_channel_config audio_ping_cfg;
-static dma_channel_config audio_pong_cfg;
 
-static int16_t ping_audio[NUM_OUT_SAMPLES];
-static int16_t pong_audio[NUM_OUT_SAMPLES];
+// ring of audio blocks played by DMA
+// The data channel plays one block, then chains to the control channel which
+// writes the address of the next block in the ring and retriggers it. Once a
+// block has played its entry reverts to the silence block, so playback carries
+// on without any intervention when the DSP falls behind.
+static_assert(pwm_ring_size >= 2 && pwm_ring_size <= 8 && !(pwm_ring_size & (pwm_ring_size - 1)),
+              "pwm_ring_size must be 2, 4 or 8");
+static_assert(pwm_latency >= 1 && pwm_latency < pwm_ring_size);
+static int pwm_dma_data;
+static int pwm_dma_ctrl;
+static dma_channel_config audio_data_cfg;
+static dma_channel_config audio_ctrl_cfg;
+
+static int16_t pwm_audio[pwm_ring_size][NUM_OUT_SAMPLES];
+static int16_t silence_audio[NUM_OUT_SAMPLES];
+//read by the control channel using a ring, so must be aligned to its size
+static int16_t *pwm_block_addr[pwm_ring_size] __attribute__((aligned(pwm_ring_size * sizeof(int16_t *))));
+
+//the irq runs on core 0 and the DSP on core 1
+static critical_section_t pwm_ring_lock;
+static volatile uint32_t blocks_started;
+static uint32_t next_slot;
+static bool last_block_silent;
+static volatile uint32_t underruns = 0;
+static uint32_t overruns = 0;
+
+// rate matching
+// The PWM runs at system_clock/(pwm_max+1), a little faster than
+// pwm_audio_sample_rate unless the system clock divides exactly, while the
+// ADC runs at exactly adc_sample_rate. Each block is resampled by a small
+// fraction so that the audio queued for playback stays at the target and the
+// silence block is only played after a real dropout, see
+// simulations/pwm_rate_match.py
+static const int32_t pwm_target_samples = pwm_latency * PWM_AUDIO_NUM_SAMPLES;
+static const int32_t pwm_max_adjust = (1 << 24) / 100; //1% in Q24
+static int16_t pending[2 * PWM_AUDIO_NUM_SAMPLES + 4];  //resampled, not yet queued
+static uint16_t num_pending;
+static int16_t last_sample;
+static uint32_t phase;              //Q24 position after last_sample
+static int32_t avg_level;           //Q8 samples
+static int32_t integral;
+static int32_t rate_adjust;         //Q24
+static bool priming;
+static bool rate_matching;
 
 static uint32_t pwm_max;
-static uint32_t pwm_scale;
 
-const uint32_t ramp_samples = 500;
+const uint32_t ramp_bits = 9;
+const uint32_t ramp_samples = 1 << ramp_bits;
 static uint32_t ramp=ramp_samples;
 static bool ground = false;
 
-static void interpolate(int16_t sample, int16_t pwm_samples[], int16_t gain) {
+// second order noise shaping moves the PWM quantisation noise above the
+// audio band, see simulations/pwm_noise_shaping.py
+static const bool noise_shaping = true;
 
-  // digital volume control
-  sample = ((int32_t)sample * gain) >> 8;
+// the interpolator works in fixed point with frac_bits fractional bits of
+// a PWM level, the 4 extra bits come from the x16 interpolation integrator
+static_assert(interpolation_rate == 16);
+const uint8_t level_frac_bits = 8;
+const uint8_t frac_bits = level_frac_bits + 4;
 
-  // shift up
-  sample += INT16_MAX;
-  sample = (uint16_t)sample / pwm_scale;
+static void __not_in_flash_func(interpolate_block)(int16_t samples[], int16_t pwm_samples[], int16_t gain) {
 
-  //apply soft mute
-  if (ground) {
-    sample = ramp*sample/ramp_samples;
-    if(ramp) ramp--;
-  } else {
-    sample = ramp*sample/ramp_samples;
-    if(ramp<ramp_samples) ramp++;
-  }
+  static int32_t last_level = 0;
+  static int32_t integrator = 0;
+  static int32_t error1 = 0;
+  static int32_t error2 = 0;
+
+  for (uint16_t i = 0; i < PWM_AUDIO_NUM_SAMPLES; i++) {
+
+    // digital volume control
+    int32_t sample = ((int32_t)samples[i] * gain) >> 8;
+
+    // shift up and scale to PWM level 0 -> pwm_max
+    int32_t level = ((sample + 32768) * pwm_max) >> (16 - level_frac_bits);
 
-  // interpolate to PWM rate
-  static int16_t last_sample = 0;
-  int32_t comb = sample - last_sample;
-  last_sample = sample;
-  for (uint8_t subsample = 0; subsample < interpolation_rate; ++subsample) {
-    static int32_t integrator = 0;
-    integrator += comb;
-    pwm_samples[subsample] = integrator / interpolation_rate;
+    //apply soft mute
+    level = (level * (int32_t)ramp) >> ramp_bits;
+    if (ground) {
+      if(ramp) ramp--;
+    } else {
+      if(ramp<ramp_samples) ramp++;
+    }
+
+    // interpolate to PWM rate
+    const int32_t comb = level - last_level;
+    last_level = level;
+    for (uint8_t subsample = 0; subsample < interpolation_rate; ++subsample) {
+      integrator += comb;
+
+      // quantise to a whole PWM level
+      int32_t shaped = integrator;
+      if (noise_shaping) shaped -= 2 * error1 - error2;
+      int32_t quantised = (shaped + (1 << (frac_bits - 1))) >> frac_bits;
+      if (quantised < 0) quantised = 0;
+      if (quantised > (int32_t)pwm_max) quantised = pwm_max;
+
+      // clamp the error so that clipping can't make the loop unstable
+      int32_t error = (quantised << frac_bits) - shaped;
+      if (error > (1 << frac_bits)) error = 1 << frac_bits;
+      if (error < -(1 << frac_bits)) error = -(1 << frac_bits);
+      error2 = error1;
+      error1 = error;
+
+      pwm_samples[i * interpolation_rate + subsample] = quantised;
+    }
   }
 }
 
+static void __not_in_flash_func(pwm_dma_handler)(void) {
+
+  // playing     ####|####|####|####|####|####
+  // slot         0    1    2    3    4    5
+  // ctrl            ^    ^    ^    ^    ^      write next block address
+  // dsp queues slots up to pwm_ring_size - 1 ahead of the one playing
+
+  if (!(dma_hw->ints0 & (1u << pwm_dma_data))) return;
+  dma_hw->ints0 = 1u << pwm_dma_data;
+
+  critical_section_enter_blocking(&pwm_ring_lock);
+
+  //the finished block won't be read again until the next pass of the ring
+  pwm_block_addr[blocks_started % pwm_ring_size] = silence_audio;
+  blocks_started = blocks_started + 1;
+
+  //the control channel has already started the next block, count the
+  //transitions from audio to silence
+  const uintptr_t read_addr = dma_hw->ch[pwm_dma_data].read_addr;
+  const bool silent = read_addr >= (uintptr_t)silence_audio &&
+                      read_addr < (uintptr_t)(silence_audio + NUM_OUT_SAMPLES);
+  if (silent && !last_block_silent) underruns = underruns + 1;
+  last_block_silent = silent;
+
+  critical_section_exit(&pwm_ring_lock);
+}
+
 void pwm_audio_sink_init(void) {
   gpio_set_function(PIN_AUDIO, GPIO_FUNC_PWM);
   gpio_set_drive_strength(PIN_AUDIO, GPIO_DRIVE_STRENGTH_12MA);
@@ -66,59 +161,163 @@ void pwm_audio_sink_init(void) {
   pwm_config_set_wrap(&config, pwm_max);
   pwm_init(audio_pwm_slice_num, &config, true);
 
-  pwm_dma_ping = dma_claim_unused_channel(true);
-  pwm_dma_pong = dma_claim_unused_channel(true);
-  audio_ping_cfg = dma_channel_get_default_config(pwm_dma_ping);
-  audio_pong_cfg = dma_channel_get_default_config(pwm_dma_pong);
+  critical_section_init(&pwm_ring_lock);
 
-  channel_config_set_transfer_data_size(&audio_ping_cfg, DMA_SIZE_16);
-  channel_config_set_read_increment(&audio_ping_cfg, true);
-  channel_config_set_write_increment(&audio_ping_cfg, false);
-  channel_config_set_dreq(&audio_ping_cfg,
-                          DREQ_PWM_WRAP0 + audio_pwm_slice_num);
+  pwm_dma_data = dma_claim_unused_channel(true);
+  pwm_dma_ctrl = dma_claim_unused_channel(true);
+  audio_data_cfg = dma_channel_get_default_config(pwm_dma_data);
+  audio_ctrl_cfg = dma_channel_get_default_config(pwm_dma_ctrl);
 
-  channel_config_set_transfer_data_size(&audio_pong_cfg, DMA_SIZE_16);
-  channel_config_set_read_increment(&audio_pong_cfg, true);
-  channel_config_set_write_increment(&audio_pong_cfg, false);
-  channel_config_set_dreq(&audio_pong_cfg,
+  channel_config_set_transfer_data_size(&audio_data_cfg, DMA_SIZE_16);
+  channel_config_set_read_increment(&audio_data_cfg, true);
+  channel_config_set_write_increment(&audio_data_cfg, false);
+  channel_config_set_dreq(&audio_data_cfg,
                           DREQ_PWM_WRAP0 + audio_pwm_slice_num);
+  channel_config_set_chain_to(&audio_data_cfg, pwm_dma_ctrl);
+
+  channel_config_set_transfer_data_size(&audio_ctrl_cfg, DMA_SIZE_32);
+  channel_config_set_read_increment(&audio_ctrl_cfg, true);
+  channel_config_set_write_increment(&audio_ctrl_cfg, false);
+  channel_config_set_ring(&audio_ctrl_cfg, false, __builtin_ctz(sizeof(pwm_block_addr)));
+
+  irq_add_shared_handler(DMA_IRQ_0, pwm_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
 }
 
-void pwm_audio_sink_start(void) {
-  dma_channel_configure(pwm_dma_ping, &audio_ping_cfg,
-                        &pwm_hw->slice[audio_pwm_slice_num].cc, ping_audio,
-                        NUM_OUT_SAMPLES, false);
-  dma_channel_configure(pwm_dma_pong, &audio_pong_cfg,
-                        &pwm_hw->slice[audio_pwm_slice_num].cc, pong_audio,
+//playback from the sd card is paced by the sink, so it doesn't rate match
+void pwm_audio_sink_start(bool rate_match) {
+
+  //start with pwm_latency blocks of silence queued
+  for (uint8_t slot = 0; slot < pwm_ring_size; ++slot) {
+    pwm_block_addr[slot] = silence_audio;
+  }
+  blocks_started = 0;
+  next_slot = pwm_latency;
+  last_block_silent = true;
+  num_pending = 0;
+  integral = 0;
+  rate_adjust = 0;
+  priming = true;
+  rate_matching = rate_match;
+
+  dma_channel_configure(pwm_dma_data, &audio_data_cfg,
+                        &pwm_hw->slice[audio_pwm_slice_num].cc, silence_audio,
                         NUM_OUT_SAMPLES, false);
+  dma_channel_set_irq0_enabled(pwm_dma_data, true);
+  dma_channel_configure(pwm_dma_ctrl, &audio_ctrl_cfg,
+                        &dma_hw->ch[pwm_dma_data].al3_read_addr_trig, pwm_block_addr,
+                        1, true);
 }
 
 void pwm_audio_sink_stop(void) {
-  dma_channel_cleanup(pwm_dma_ping);
-  dma_channel_cleanup(pwm_dma_pong);
+  dma_channel_cleanup(pwm_dma_data);
+  dma_channel_cleanup(pwm_dma_ctrl);
 }
 
-uint32_t pwm_audio_sink_push(int16_t samples[PWM_AUDIO_NUM_SAMPLES], int16_t gain) {
-  static bool toggle = false;
-  uint32_t time;
+static void queue_block(int16_t samples[PWM_AUDIO_NUM_SAMPLES], int16_t gain) {
 
-  if (toggle) {
-    for (uint16_t i = 0; i < PWM_AUDIO_NUM_SAMPLES; i++) {
-      interpolate(samples[i], &ping_audio[i * interpolation_rate], gain);
-    }
-    time = time_us_32();
-    dma_channel_wait_for_finish_blocking(pwm_dma_pong);
-    dma_channel_set_read_addr(pwm_dma_ping, ping_audio, true);
-  } else {
-    for (uint16_t i = 0; i < PWM_AUDIO_NUM_SAMPLES; i++) {
-      interpolate(samples[i], &pong_audio[i * interpolation_rate], gain);
+  //all buffers are queued, drop the block rather than wait for playback
+  if (next_slot - blocks_started >= pwm_ring_size) {
+    overruns++;
+    return;
+  }
+
+  //the buffer isn't referenced by the ring until it is queued
+  const uint8_t index = next_slot % pwm_ring_size;
+  interpolate_block(samples, pwm_audio[index], gain);
+
+  //queue the block unless playback has already passed its slot
+  critical_section_enter_blocking(&pwm_ring_lock);
+  if ((int32_t)(next_slot - blocks_started) > 0) {
+    pwm_block_addr[index] = pwm_audio[index];
+  }
+  critical_section_exit(&pwm_ring_lock);
+  next_slot++;
+}
+
+//audio samples waiting to be played, including the rest of the playing block
+static int32_t playback_level(void) {
+  critical_section_enter_blocking(&pwm_ring_lock);
+  const uint32_t playing = blocks_started;
+  const uint32_t remaining = dma_hw->ch[pwm_dma_data].transfer_count;
+  critical_section_exit(&pwm_ring_lock);
+  return (int32_t)(next_slot - playing - 1) * PWM_AUDIO_NUM_SAMPLES +
+         remaining / interpolation_rate + num_pending;
+}
+
+void pwm_audio_sink_push(int16_t samples[PWM_AUDIO_NUM_SAMPLES], int16_t gain) {
+
+  //playback has caught up and played silence, queue a full latency ahead again
+  if ((int32_t)(next_slot - blocks_started) <= 0) {
+    next_slot = blocks_started + pwm_latency;
+    num_pending = 0;
+    priming = true;
+  }
+
+  //after (re)starting, pad with silence so that the level starts on target
+  int32_t level = playback_level();
+  if (priming) {
+    int32_t padding = rate_matching ? pwm_target_samples - level : 0;
+    if (padding > PWM_AUDIO_NUM_SAMPLES) padding = PWM_AUDIO_NUM_SAMPLES;
+    while (padding-- > 0) pending[num_pending++] = 0;
+    level = playback_level();
+    avg_level = pwm_target_samples << 8;
+    last_sample = 0;
+    phase = 0;
+    priming = false;
+  }
+
+  //smooth out the jitter in when blocks arrive, then PI control of the step,
+  //the integral is kept across dropouts because the clock error doesn't change
+  avg_level += ((level << 8) - avg_level) >> 4;
+  const int32_t error = avg_level - (pwm_target_samples << 8);
+  integral += error;
+  if (integral > (pwm_max_adjust << 12)) integral = pwm_max_adjust << 12;
+  if (integral < -(pwm_max_adjust << 12)) integral = -(pwm_max_adjust << 12);
+  int32_t adjust = (error << 4) + (integral >> 12);
+  if (adjust > pwm_max_adjust) adjust = pwm_max_adjust;
+  if (adjust < -pwm_max_adjust) adjust = -pwm_max_adjust;
+  if (!rate_matching) adjust = 0;
+  rate_adjust = adjust;
+  const uint32_t step = (1u << 24) + adjust;
+
+  //linear interpolation, a step below 1 makes more samples than it takes
+  for (uint16_t i = 0; i < PWM_AUDIO_NUM_SAMPLES; i++) {
+    const int32_t next_sample = samples[i];
+    while (phase < (1u << 24)) {
+      const int32_t frac = phase >> 10; //Q14
+      pending[num_pending++] = last_sample + (((next_sample - last_sample) * frac) >> 14);
+      phase += step;
     }
-    time = time_us_32();
-    dma_channel_wait_for_finish_blocking(pwm_dma_ping);
-    dma_channel_set_read_addr(pwm_dma_pong, pong_audio, true);
+    phase -= 1u << 24;
+    last_sample = next_sample;
+  }
+
+  //queue whole blocks, usually one per push
+  uint16_t used = 0;
+  while (num_pending - used >= PWM_AUDIO_NUM_SAMPLES) {
+    queue_block(&pending[used], gain);
+    used += PWM_AUDIO_NUM_SAMPLES;
   }
-  toggle ^= 1;
-  return time;
+  num_pending -= used;
+  memmove(pending, &pending[used], num_pending * sizeof(int16_t));
+}
+
+uint8_t pwm_audio_sink_fill(void) {
+  //blocks queued ahead of the one playing
+  const int32_t fill = (int32_t)(next_slot - blocks_started) - 1;
+  return fill > 0 ? fill : 0;
+}
+
+uint32_t pwm_audio_sink_underruns(void) {
+  return underruns;
+}
+
+uint32_t pwm_audio_sink_overruns(void) {
+  return overruns;
+}
+
+int16_t pwm_audio_sink_rate_ppm(void) {
+  return ((int64_t)rate_adjust * 1000000) >> 24;
 }
 
 void disable_pwm(uint8_t tuning_option)
@@ -159,5 +358,9 @@ void enable_pwm(uint8_t tuning_option)
 void pwm_audio_sink_update_pwm_max(uint32_t new_max) {
   pwm_max = new_max;
   pwm_set_wrap(audio_pwm_slice_num, pwm_max);
-  pwm_scale = 1 + ((INT16_MAX * 2) / pwm_max);
+
+  //played whenever the DSP hasn't queued a block in time
+  for (uint16_t i = 0; i < NUM_OUT_SAMPLES; i++) {
+    silence_audio[i] = pwm_max / 2;
+  }
 }
@@ -6,9 +6,13 @@
 #define PWM_AUDIO_NUM_SAMPLES (adc_block_size / decimation_rate)
 
 void pwm_audio_sink_init(void);
-void pwm_audio_sink_start(void);
+void pwm_audio_sink_start(bool rate_match = true);
 void pwm_audio_sink_stop(void);
-uint32_t pwm_audio_sink_push(int16_t samples[PWM_AUDIO_NUM_SAMPLES], int16_t gain);
+void pwm_audio_sink_push(int16_t samples[PWM_AUDIO_NUM_SAMPLES], int16_t gain);
+uint8_t pwm_audio_sink_fill(void);
+uint32_t pwm_audio_sink_underruns(void);
+uint32_t pwm_audio_sink_overruns(void);
+int16_t pwm_audio_sink_rate_ppm(void);
 void pwm_audio_sink_update_pwm_max(uint32_t new_max);
 void disable_pwm(uint8_t tuning_option);
 void enable_pwm(uint8_t tuning_option);
@@ -0,0 +1,112 @@
+#include "resampler.h"
+
+#include "pico/stdlib.h"
+
+// taps for each phase, oldest input sample first, Q14
+// generated by simulations/resampler_des.py
+static const int16_t coefficients_15k_to_48k[16][resampler_taps_per_phase] = {
+    {    -1,     3,    -6,    12,   -21,    35,   -56,    87,  -137,   229,  -484, 16359,
+        517,  -238,   141,   -89,    57,   -36,    22,   -13,     7,    -3,     1,     0},
+    {    -3,     8,   -18,    35,   -61,   101,  -161,   250,  -393,   654, -1347, 16146,
+       1640,  -731,   429,  -272,   175,  -111,    68,   -39,    21,   -10,     4,    -1},
+    {    -4,    13,   -28,    54,   -96,   160,  -254,   396,  -620,  1026, -2063, 15726,
+       2867, -1234,   718,  -454,   292,  -185,   113,   -66,    35,   -16,     6,    -2},
+    {    -5,    16,   -36,    70,  -125,   209,  -333,   518,  -810,  1333, -2625, 15109,
+       4177, -1728,   997,  -628,   404,  -257,   158,   -91,    49,   -23,     9,    -2},
+    {    -6,    18,   -42,    83,  -147,   246,  -394,   614,  -959,  1570, -3032, 14309,
+       5544, -2193,  1252,  -787,   507,  -322,   198,  -116,    62,   -30,    12,    -3},
+    {    -6,    20,   -46,    91,  -163,   273,  -437,   682, -1063,  1731, -3286, 13345,
+       6941, -2609,  1474,  -924,   594,  -378,   233,  -137,    74,   -36,    15,    -4},
+    {    -6,    20,   -47,    94,  -170,   287,  -461,   720, -1121,  1817, -3393, 12240,
+       8339, -2956,  1650, -1031,   663,  -423,   261,  -154,    84,   -41,    17,    -5},
+    {    -6,    20,   -47,    94,  -171,   289,  -466,   728, -1134,  1829, -3365, 11018,
+       9708, -3214,  1771, -1102,   708,  -452,   280,  -165,    91,   -45,    19,    -6},
+    {    -6,    19,   -45,    91,  -165,   280,  -452,   708, -1102,  1771, -3214,  9708,
+      11018, -3365,  1829, -1134,   728,  -466,   289,  -171,    94,   -47,    20,    -6},
+    {    -5,    17,   -41,    84,  -154,   261,  -423,   663, -1031,  1650, -2956,  8339,
+      12240, -3393,  1817, -1121,   720,  -461,   287,  -170,    94,   -47,    20,    -6},
+    {    -4,    15,   -36,    74,  -137,   233,  -378,   594,  -924,  1474, -2609,  6941,
+      13345, -3286,  1731, -1063,   682,  -437,   273,  -163,    91,   -46,    20,    -6},
+    {    -3,    12,   -30,    62,  -116,   198,  -322,   507,  -787,  1252, -2193,  5544,
+      14309, -3032,  1570,  -959,   614,  -394,   246,  -147,    83,   -42,    18,    -6},
+    {    -2,     9,   -23,    49,   -91,   158,  -257,   404,  -628,   997, -1728,  4177,
+      15109, -2625,  1333,  -810,   518,  -333,   209,  -125,    70,   -36,    16,    -5},
+    {    -2,     6,   -16,    35,   -66,   113,  -185,   292,  -454,   718, -1234,  2867,
+      15726, -2063,  1026,  -620,   396,  -254,   160,   -96,    54,   -28,    13,    -4},
+    {    -1,     4,   -10,    21,   -39,    68,  -111,   175,  -272,   429,  -731,  1640,
+      16146, -1347,   654,  -393,   250,  -161,   101,   -61,    35,   -18,     8,    -3},
+    {     0,     1,    -3,     7,   -13,    22,   -36,    57,   -89,   141,  -238,   517,
+      16359,  -484,   229,  -137,    87,   -56,    35,   -21,    12,    -6,     3,    -1},
+};
+
+static const int16_t coefficients_30k_to_48k[8][resampler_taps_per_phase] = {
+    {    -2,     6,   -12,    24,   -42,    69,  -109,   170,  -268,   448,  -933, 16279,
+       1064,  -482,   284,  -180,   116,   -73,    44,   -25,    13,    -6,     2,    -1},
+    {    -5,    14,   -32,    62,  -111,   184,  -294,   459,  -719,  1187, -2363, 15442,
+       3513, -1483,   859,  -542,   348,  -221,   135,   -78,    41,   -20,     8,    -2},
+    {    -6,    19,   -43,    86,  -155,   260,  -416,   650, -1016,  1659, -3177, 13846,
+       6240, -2408,  1367,  -857,   551,  -350,   215,  -125,    68,   -32,    13,    -3},
+    {    -6,    20,   -47,    94,  -170,   288,  -464,   726, -1132,  1831, -3395, 11641,
+       9029, -3096,  1717, -1069,   687,  -438,   270,  -159,    87,   -42,    17,    -5},
+    {    -5,    17,   -42,    87,  -159,   270,  -438,   687, -1069,  1717, -3096,  9029,
+      11641, -3395,  1831, -1132,   726,  -464,   288,  -170,    94,   -47,    20,    -6},
+    {    -3,    13,   -32,    68,  -125,   215,  -350,   551,  -857,  1367, -2408,  6240,
+      13846, -3177,  1659, -1016,   650,  -416,   260,  -155,    86,   -43,    19,    -6},
+    {    -2,     8,   -20,    41,   -78,   135,  -221,   348,  -542,   859, -1483,  3513,
+      15442, -2363,  1187,  -719,   459,  -294,   184,  -111,    62,   -32,    14,    -5},
+    {    -1,     2,    -6,    13,   -25,    44,   -73,   116,  -180,   284,  -482,  1064,
+      16279,  -933,   448,  -268,   170,  -109,    69,   -42,    24,   -12,     6,    -2},
+};
+
+const s_resampler_filter resampler_15k_to_48k = {16u, 5u, coefficients_15k_to_48k};
+const s_resampler_filter resampler_30k_to_48k = {8u, 5u, coefficients_30k_to_48k};
+
+resampler::resampler(const s_resampler_filter &f) : filter(f)
+{
+}
+
+uint16_t __not_in_flash_func(resampler::process)(const int16_t input[], uint16_t num_input, uint8_t input_stride,
+                                                 int16_t output[], uint8_t output_stride)
+{
+  //append the new samples to the last taps_per_phase - 1
+  const uint8_t history = resampler_taps_per_phase - 1;
+  for(uint16_t idx = 0; idx < num_input; ++idx)
+  {
+    buffer[history + idx] = input[idx * input_stride];
+  }
+
+  //each output advances down steps at the upsampled rate, base is the
+  //oldest input sample used by the current output
+  uint16_t num_output = 0;
+  uint16_t base = 0;
+  while(base < num_input)
+  {
+    const int16_t *x = &buffer[base];
+    const int16_t *c = filter.coefficients[phase];
+    int32_t accumulator = 1 << 13;
+    for(uint8_t tap = 0; tap < resampler_taps_per_phase; ++tap)
+    {
+      accumulator += x[tap] * c[tap];
+    }
+    accumulator >>= 14;
+    if(accumulator > INT16_MAX) accumulator = INT16_MAX;
+    if(accumulator < INT16_MIN) accumulator = INT16_MIN;
+    output[num_output * output_stride] = accumulator;
+    num_output++;
+
+    phase += filter.down;
+    if(phase >= filter.up)
+    {
+      phase -= filter.up;
+      base++;
+    }
+  }
+
+  //keep the most recent samples for the next block
+  for(uint8_t idx = 0; idx < history; ++idx)
+  {
+    buffer[idx] = buffer[num_input + idx];
+  }
+
+  return num_output;
+}
@@ -0,0 +1,38 @@
+#ifndef __RESAMPLER_H__
+#define __RESAMPLER_H__
+
+#include <cstdint>
+#include "rx_definitions.h"
+
+// polyphase resamplers to the 48 kHz usb rate, see simulations/resampler_des.py
+//  15 kHz audio or IQ: upsample by 16 and decimate by 5
+//  30 kHz wideband IQ: upsample by 8 and decimate by 5
+const uint8_t  resampler_taps_per_phase = 24u;
+const uint16_t resampler_max_input = adc_block_size / cic_decimation_rate;
+const uint16_t resampler_max_output = (((adc_block_size / decimation_rate) * 16u) + 4u) / 5u;
+const uint32_t resampler_output_rate = audio_sample_rate * 16u / 5u;
+
+struct s_resampler_filter
+{
+  uint8_t up;
+  uint8_t down;
+  const int16_t (*coefficients)[resampler_taps_per_phase];
+};
+
+extern const s_resampler_filter resampler_15k_to_48k;
+extern const s_resampler_filter resampler_30k_to_48k;
+
+class resampler
+{
+  public:
+  resampler(const s_resampler_filter &f);
+  uint16_t process(const int16_t input[], uint16_t num_input, uint8_t input_stride,
+                   int16_t output[], uint8_t output_stride);
+
+  private:
+  const s_resampler_filter &filter;
+  int16_t buffer[resampler_taps_per_phase - 1 + resampler_max_input] = {0};
+  uint8_t phase = 0;
+};
+
+#endif
@@ -12,20 +12,38 @@
 #include "ring_buffer_lib.h"
 #include "pins.h"
 #include "pwm_audio_sink.h"
+#include "vendor_stream.h"
 #include "clocks.h"
+#include "sdcard.h"
+
+//the usb audio descriptor has to advertise the rate the resampler produces
+static_assert(resampler_output_rate == CFG_TUD_AUDIO_FUNC_1_SAMPLE_RATE);
 
 //ring buffer for USB data
-#define USB_BUF_SIZE (sizeof(int16_t) * 8 * (1 + (adc_block_size/decimation_rate)))
+#define USB_BUF_SIZE (sizeof(int16_t) * 8 * (1 + resampler_max_output))
 static ring_buffer_t usb_ring_buffer;
 static uint8_t usb_buf[USB_BUF_SIZE];
 
-//buffers and dma for ADC
-int rx::adc_dma_ping;
-int rx::adc_dma_pong;
-dma_channel_config rx::ping_cfg;
-dma_channel_config rx::pong_cfg;
-uint16_t rx::ping_samples[adc_block_size];
-uint16_t rx::pong_samples[adc_block_size];
+// The receiver sample clock drifts against the usb frame clock, so usb
+// packets are resampled by a small fraction, adjusted to keep the ring
+// buffer half full. Counts are in stereo (or IQ) samples.
+static const uint16_t usb_frame_bytes = 2 * sizeof(int16_t);
+static const int32_t usb_target_frames = USB_BUF_SIZE / (2 * usb_frame_bytes);
+static const int32_t usb_max_adjust = (1 << 24) / 100; //1% in Q24
+static volatile uint32_t usb_dropped_samples = 0;
+static volatile uint32_t usb_duplicated_samples = 0;
+static volatile uint32_t usb_sent_samples = 0;
+static volatile int32_t usb_rate_adjust = 0;
+
+//ring of buffers and dma for ADC
+int rx::adc_dma_data;
+int rx::adc_dma_ctrl;
+dma_channel_config rx::adc_data_cfg;
+dma_channel_config rx::adc_ctrl_cfg;
+uint16_t rx::adc_samples[adc_ring_size][adc_block_size];
+//read by the control channel using a ring, so must be aligned to its size
+uint16_t *rx::adc_block_addr[adc_ring_size] __attribute__((aligned(adc_ring_size * sizeof(uint16_t *))));
+volatile uint32_t rx::adc_blocks_produced;
 
 bool rx::audio_running;
 
@@ -35,22 +53,16 @@ dma_channel_config rx::capture_cfg;
 
 void rx::dma_handler() {
 
+    // adc data    ####|####|####|####|####|####
+    // block        0    1    2    3    0    1
+    // ctrl            ^    ^    ^    ^    ^      write next block address
+    // processing       ###  ###  ###  ###  ###  (may lag up to ring size - 1)
 
-    // adc ping             ####    ####
-    // adc pong                 ####    ####
-    // processing ping          ###
-    // processing pong              ###
-
-    if(dma_hw->ints0 & (1u << adc_dma_ping))
-    {
-      dma_channel_set_write_addr(adc_dma_ping, ping_samples, false);
-      dma_hw->ints0 = 1u << adc_dma_ping;
-    }
-
-    if(dma_hw->ints0 & (1u << adc_dma_pong))
+    //the control channel re-arms the data channel, just count completed blocks
+    if(dma_hw->ints0 & (1u << adc_dma_data))
     {
-      dma_channel_set_write_addr(adc_dma_pong, pong_samples, false);
-      dma_hw->ints0 = 1u << adc_dma_pong;
+      dma_hw->ints0 = 1u << adc_dma_data;
+      adc_blocks_produced = adc_blocks_produced + 1;
     }
 
 }
@@ -70,6 +82,22 @@ void rx::tune()
 
   if(sem_try_acquire(&settings_semaphore))
   {
+    //during playback the nco is left alone, tuning moves the offset from
+    //the recorded frequency instead
+    if(settings_to_apply.playback)
+    {
+      const double playback_offset_Hz = settings_to_apply.tuned_frequency_Hz - settings_to_apply.playback_frequency_Hz;
+      if(playback_offset_Hz != offset_frequency_Hz || tuned_frequency_Hz != 0)
+      {
+        offset_frequency_Hz = playback_offset_Hz;
+        rx_dsp_inst.set_frequency_offset_Hz(offset_frequency_Hz);
+        tuned_frequency_Hz = 0; //force the nco to be retuned when playback stops
+        status.tuned = true;
+      }
+      sem_release(&settings_semaphore);
+      return;
+    }
+
     if(settings_to_apply.enable_external_nco)
     {
       //disable internal nco
@@ -82,9 +110,7 @@ void rx::tune()
         gpio_set_dir(PIN_NCO_2, GPIO_IN);
         internal_nco_active = false;
         //use a fixed clock frequency when using external NCO
-        uint32_t vco_freq = (12000000 / possible_frequencies[0].refdiv) * possible_frequencies[0].fbdiv;
-        set_sys_clock_pll(vco_freq, possible_frequencies[0].postdiv1, possible_frequencies[0].postdiv2);
-        system_clock_rate = possible_frequencies[0].frequency;
+        nco_set_system_clock(0, system_clock_rate);
         pwm_audio_sink_update_pwm_max((system_clock_rate/pwm_audio_sample_rate)-1);
         rx_dsp_inst.amsync_reset();
         status.tuned = true;
@@ -155,15 +181,25 @@ void rx::tune()
         if_mode = settings_to_apply.if_mode;
         if_frequency_hz_over_100 = settings_to_apply.if_frequency_hz_over_100;
 
-        disable_pwm(settings_to_apply.tuning_option);
+        //the pwm only needs to be quietened if the system clock changes
+        const uint32_t retune_start = time_us_32();
+        const s_nco_plan plan = nco_plan(adjusted_tuned_frequency_Hz, if_frequency_hz_over_100, if_mode);
+        const bool pll_change = nco_plan_changes_pll(plan);
+        if(pll_change) disable_pwm(settings_to_apply.tuning_option);
 
-        nco_frequency_Hz = nco_set_frequency(pio, sm, adjusted_tuned_frequency_Hz, system_clock_rate, if_frequency_hz_over_100, if_mode);
+        nco_frequency_Hz = nco_apply_plan(pio, sm, plan, system_clock_rate);
         offset_frequency_Hz = adjusted_tuned_frequency_Hz - nco_frequency_Hz;
-        pwm_audio_sink_update_pwm_max((system_clock_rate/pwm_audio_sample_rate)-1);
         rx_dsp_inst.set_frequency_offset_Hz(offset_frequency_Hz);
 
-        enable_pwm(settings_to_apply.tuning_option);
+        if(pll_change)
+        {
+          pwm_audio_sink_update_pwm_max((system_clock_rate/pwm_audio_sample_rate)-1);
+          enable_pwm(settings_to_apply.tuning_option);
+          status.pll_changes++;
+          restart_pending = true;
+        }
         rx_dsp_inst.amsync_reset();
+        status.retune_us = std::max(status.retune_us, time_us_32() - retune_start);
         status.tuned = true;
       }
     }
@@ -196,15 +232,46 @@ void rx::update_status()
      avg_level = (avg_level - (avg_level >> 2)) + (ring_buffer_get_num_bytes(&usb_ring_buffer) >> 2);
      status.usb_buf_level = 100 * avg_level / USB_BUF_SIZE;
      status.tuning_offset_Hz = rx_dsp_inst.get_tuning_offset_Hz();
+     status.settings_changes = settings_changes;
+     status.dropped_blocks = dropped_blocks;
+     status.adc_overruns = adc_overruns;
+     status.audio_fill = pwm_audio_sink_fill();
+     status.audio_underruns = pwm_audio_sink_underruns();
+     status.audio_overruns = pwm_audio_sink_overruns();
+     status.audio_rate_ppm = pwm_audio_sink_rate_ppm();
+     status.usb_dropped_samples = usb_dropped_samples;
+     status.usb_duplicated_samples = usb_duplicated_samples;
+     status.usb_sent_samples = usb_sent_samples;
+     status.usb_rate_ppm = ((int64_t)usb_rate_adjust * 1000000) >> 24;
 
      sem_release(&settings_semaphore);
    }
 }
 
+//Most settings only affect the DSP and can be applied between blocks while
+//the ADC keeps streaming. Switching oscillator reprograms the PLL, so the
+//stream is restarted. Retuning the internal NCO usually only changes the PIO
+//divider, tune() requests a restart when its plan changes the PLL.
+bool rx::restart_required()
+{
+  if(settings_to_apply.playback != applied_settings.playback) return true;
+
+  //the recording is retuned by shifting it, the adc isn't running
+  if(settings_to_apply.playback) return false;
+
+  if(settings_to_apply.enable_external_nco != applied_settings.enable_external_nco) return true;
+
+  return false;
+}
+
 void rx::apply_settings()
 {
    if(sem_try_acquire(&settings_semaphore))
    {
+      if(restart_required()) restart_pending = true;
+      applied_settings = settings_to_apply;
+      playback = settings_to_apply.playback;
+      settings_changes++;
 
       if(settings_to_apply.tuned_frequency_Hz > (settings_to_apply.band_7_limit * 125000))
       {
@@ -322,7 +389,7 @@ void rx::apply_settings()
       // apply SD card WAV file saving
       rx_dsp_inst.set_sd_card_save(settings_to_apply.sd_card_save);
 
-      stream_raw_iq = settings_to_apply.stream_raw_iq;
+      usb_stream = settings_to_apply.usb_stream;
 
       settings_changed = false;
       sem_release(&settings_semaphore);
@@ -343,8 +410,12 @@ rx::rx(rx_settings & _settings_to_apply, rx_status & _status) : settings_to_appl
 {
 
     settings_to_apply.suspend = false;
+    settings_to_apply.playback = false;
     suspend = false;
-    stream_raw_iq = 0;
+    settings_changed = false;
+    restart_pending = false;
+    applied_settings = settings_to_apply;
+    usb_stream = STREAM_AUDIO;
 
     //Configure PIO to act as quadrature oscilator
     pio = pio0;
@@ -400,22 +471,29 @@ rx::rx(rx_settings & _settings_to_apply, rx_status & _status) : settings_to_appl
     gpio_set_dir(PIN_BAND_2, GPIO_OUT);
 
     // Configure DMA for ADC transfers
-    adc_dma_ping = dma_claim_unused_channel(true);
-    adc_dma_pong = dma_claim_unused_channel(true);
-    ping_cfg = dma_channel_get_default_config(adc_dma_ping);
-    pong_cfg = dma_channel_get_default_config(adc_dma_pong);
-
-    channel_config_set_transfer_data_size(&ping_cfg, DMA_SIZE_16);
-    channel_config_set_read_increment(&ping_cfg, false);
-    channel_config_set_write_increment(&ping_cfg, true);
-    channel_config_set_dreq(&ping_cfg, DREQ_ADC);// Pace transfers based on availability of ADC samples
-    channel_config_set_chain_to(&ping_cfg, adc_dma_pong);
-
-    channel_config_set_transfer_data_size(&pong_cfg, DMA_SIZE_16);
-    channel_config_set_read_increment(&pong_cfg, false);
-    channel_config_set_write_increment(&pong_cfg, true);
-    channel_config_set_dreq(&pong_cfg, DREQ_ADC);// Pace transfers based on availability of ADC samples
-    channel_config_set_chain_to(&pong_cfg, adc_dma_ping);
+    // The data channel fills one block, then chains to the control channel
+    // which writes the address of the next block in the ring and retriggers it
+    adc_dma_data = dma_claim_unused_channel(true);
+    adc_dma_ctrl = dma_claim_unused_channel(true);
+    adc_data_cfg = dma_channel_get_default_config(adc_dma_data);
+    adc_ctrl_cfg = dma_channel_get_default_config(adc_dma_ctrl);
+
+    channel_config_set_transfer_data_size(&adc_data_cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&adc_data_cfg, false);
+    channel_config_set_write_increment(&adc_data_cfg, true);
+    channel_config_set_dreq(&adc_data_cfg, DREQ_ADC);// Pace transfers based on availability of ADC samples
+    channel_config_set_chain_to(&adc_data_cfg, adc_dma_ctrl);
+
+    channel_config_set_transfer_data_size(&adc_ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&adc_ctrl_cfg, true);
+    channel_config_set_write_increment(&adc_ctrl_cfg, false);
+    channel_config_set_ring(&adc_ctrl_cfg, false, __builtin_ctz(sizeof(adc_block_addr)));
+
+    //entry n holds the block that follows block n
+    for(uint8_t block=0; block<adc_ring_size; ++block)
+    {
+      adc_block_addr[block] = adc_samples[(block + 1) % adc_ring_size];
+    }
 
     //settings semaphore
     sem_init(&settings_semaphore, 1, 1);
@@ -429,8 +507,9 @@ rx::rx(rx_settings & _settings_to_apply, rx_status & _status) : settings_to_appl
     channel_config_set_read_increment(&capture_cfg, true);
     channel_config_set_write_increment(&capture_cfg, true);
 
-    dma_set_irq0_channel_mask_enabled((1u<<adc_dma_ping) | (1u<<adc_dma_pong), true);
-    irq_set_exclusive_handler(DMA_IRQ_0, dma_handler);
+    //shared with the audio sink
+    dma_set_irq0_channel_mask_enabled(1u<<adc_dma_data, true);
+    irq_add_shared_handler(DMA_IRQ_0, dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
     irq_set_enabled(DMA_IRQ_0, true);
 
 
@@ -452,13 +531,104 @@ void rx::read_batt_temp()
   }
 }
 
+//Take one battery and one temperature reading while the ADC is streaming.
+//The free running conversions are paused for a few microseconds, the DMA
+//channels stay armed, and the round robin restarts on whichever of I or Q
+//the active DMA channel expects next so that the I/Q order is preserved.
+void __not_in_flash_func(rx::sample_batt_temp)()
+{
+  adc_run(false);
+  while(!(adc_hw->cs & ADC_CS_READY_BITS)) tight_loop_contents();
+  while(!adc_fifo_is_empty()) tight_loop_contents();
+
+  //keep the side readings out of the FIFO (and out of the I/Q stream)
+  adc_fifo_setup(false, false, 1, false, false);
+  adc_set_round_robin(0);
+  adc_select_input(3);
+  battery = battery - (battery >> 4) + adc_read();
+  adc_select_input(4);
+  temp = temp - (temp >> 4) + adc_read();
+
+  //even samples contain i data, the block size is even so the parity of the
+  //remaining transfer count gives the parity of the next sample
+  const uint32_t remaining = dma_channel_hw_addr(adc_dma_data)->transfer_count;
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_select_input(remaining & 1);
+  adc_set_round_robin(3);
+  adc_run(true);
+}
+
 static bool __not_in_flash_func(usb_callback)(repeating_timer_t *rt)
 {
-  (void)rt;
   usb_audio_device_task();
+  ((rx *)rt->user_data)->vendor_stream_task();
   return true; // keep repeating
 }
 
+//runs in the same context as the usb stack, so the vendor fifo is only
+//ever touched from here
+void __not_in_flash_func(rx::vendor_stream_task)()
+{
+  const uint32_t start_time = time_us_32();
+  vendor_stream_poll();
+
+  //wideband IQ blocks queued by core 1, a block is dropped rather than
+  //held if the host isn't keeping up
+  while(vendor_iq_consumed != vendor_iq_produced)
+  {
+    const uint8_t slot = vendor_iq_consumed % vendor_iq_ring_size;
+    vendor_stream_send(VENDOR_FRAME_IQ, (adc_sample_rate / cic_decimation_rate) / 10,
+                       vendor_iq_block[slot], vendor_iq_time[slot],
+                       vendor_iq[slot], sizeof(vendor_iq[slot]));
+    vendor_iq_consumed = vendor_iq_consumed + 1;
+  }
+
+  //spectrum about 20 times per second
+  static uint32_t last_spectrum_time = 0;
+  static uint32_t spectrum_sequence = 0;
+  if(vendor_stream_enabled(VENDOR_FRAME_SPECTRUM) && start_time - last_spectrum_time > 50000)
+  {
+    int16_t fft_bin;
+    const int16_t *capture = rx_dsp_inst.try_acquire_capture(fft_bin);
+    if(capture)
+    {
+      last_spectrum_time = start_time;
+      vendor_stream_send(VENDOR_FRAME_SPECTRUM, fft_bin, spectrum_sequence++, start_time,
+                         capture, 256 * sizeof(int16_t));
+      rx_dsp_inst.release_capture();
+    }
+  }
+
+  //status about 10 times per second
+  static uint32_t last_status_time = 0;
+  static uint32_t status_sequence = 0;
+  if(vendor_stream_enabled(VENDOR_FRAME_STATUS) && start_time - last_status_time > 100000)
+  {
+    if(sem_try_acquire(&settings_semaphore))
+    {
+      last_status_time = start_time;
+      s_vendor_status vendor_status = {
+        (int16_t)status.signal_strength_dBm,
+        status.battery,
+        status.temp,
+        (uint16_t)status.busy_time,
+        status.adc_overruns,
+        status.dropped_blocks,
+        status.audio_underruns,
+        status.usb_dropped_samples,
+        status.usb_duplicated_samples,
+        vendor_stream_dropped_frames(),
+        vendor_busy_time
+      };
+      sem_release(&settings_semaphore);
+      vendor_stream_send(VENDOR_FRAME_STATUS, sizeof(vendor_status), status_sequence++, start_time,
+                         &vendor_status, sizeof(vendor_status));
+    }
+  }
+
+  vendor_busy_time += time_us_32() - start_time;
+}
+
 void rx::set_alarm_pool(alarm_pool_t *p)
 {
   pool = p;
@@ -480,10 +650,83 @@ static void on_usb_set_mutevol(bool mute, int16_t vol)
 
 static void on_usb_audio_tx_ready()
 {
-  uint16_t _usb_buf[SAMPLE_BUFFER_SIZE] = {0};
+  const uint16_t frames = SAMPLE_BUFFER_SIZE / 2;
+  static int16_t last[2] = {0}, next[2] = {0}; //samples either side of phase
+  static uint32_t phase = 0;                  //Q24 position between last and next
+  static int32_t avg_fill = 0;                //Q8 frames
+  static int32_t integral = 0;
+  static bool priming = true;
+
+  int16_t _usb_buf[SAMPLE_BUFFER_SIZE] = {0};
+  const int32_t fill = ring_buffer_get_num_bytes(&usb_ring_buffer) / usb_frame_bytes;
+
+  //after running dry, hold the last sample until the buffer is back to the target
+  if(priming)
+  {
+    if(fill < usb_target_frames)
+    {
+      for(uint16_t idx = 0; idx < frames; ++idx)
+      {
+        _usb_buf[2 * idx] = next[0];
+        _usb_buf[2 * idx + 1] = next[1];
+      }
+      usb_duplicated_samples = usb_duplicated_samples + frames;
+      usb_audio_device_write(_usb_buf, sizeof(_usb_buf));
+      usb_sent_samples = usb_sent_samples + frames;
+      return;
+    }
+    priming = false;
+    avg_fill = usb_target_frames << 8;
+  }
+
+  //smooth out the block sized steps in fill level, then PI control of the step
+  avg_fill += ((fill << 8) - avg_fill) >> 4;
+  const int32_t error = avg_fill - (usb_target_frames << 8);
+  integral += error;
+  if(integral > (usb_max_adjust << 10)) integral = usb_max_adjust << 10;
+  if(integral < -(usb_max_adjust << 10)) integral = -(usb_max_adjust << 10);
+  int32_t adjust = (error << 1) + (integral >> 10);
+  if(adjust > usb_max_adjust) adjust = usb_max_adjust;
+  if(adjust < -usb_max_adjust) adjust = -usb_max_adjust;
+  usb_rate_adjust = adjust;
+  const uint32_t step = (1u << 24) + adjust;
+
+  //pop the input samples spanned by this packet
+  int16_t in[2 * (frames + 2)];
+  const uint16_t needed = (phase + (frames - 1) * step) >> 24;
+  const uint16_t got = ring_buffer_pop(&usb_ring_buffer, (uint8_t *)in, needed * usb_frame_bytes) / usb_frame_bytes;
+  for(uint16_t idx = got; idx < needed; ++idx)
+  {
+    in[2 * idx] = idx ? in[2 * idx - 2] : next[0];
+    in[2 * idx + 1] = idx ? in[2 * idx - 1] : next[1];
+  }
+  if(got < needed)
+  {
+    usb_duplicated_samples = usb_duplicated_samples + needed - got;
+    priming = true;
+  }
+
+  //linear interpolation
+  uint16_t src = 0;
+  for(uint16_t idx = 0; idx < frames; ++idx)
+  {
+    while(phase >= (1u << 24))
+    {
+      last[0] = next[0];
+      last[1] = next[1];
+      next[0] = in[2 * src];
+      next[1] = in[2 * src + 1];
+      src++;
+      phase -= 1u << 24;
+    }
+    const int32_t frac = phase >> 10; //Q14
+    _usb_buf[2 * idx] = last[0] + (((next[0] - last[0]) * frac) >> 14);
+    _usb_buf[2 * idx + 1] = last[1] + (((next[1] - last[1]) * frac) >> 14);
+    phase += step;
+  }
 
-  ring_buffer_pop(&usb_ring_buffer, (uint8_t *)_usb_buf, sizeof(_usb_buf));
   usb_audio_device_write(_usb_buf, sizeof(_usb_buf));
+  usb_sent_samples = usb_sent_samples + frames;
 }
 
 //thread safe method to get raw IQ data
@@ -497,7 +740,7 @@ uint32_t rx::get_iq_buffer_level()
   return rx_dsp_inst.get_iq_buffer_level();
 }
 
-void __not_in_flash_func(rx::process_block)(uint16_t adc_samples[], int16_t audio[])
+void __not_in_flash_func(rx::process_block)(uint16_t adc_samples[], int16_t audio[], const int16_t recorded_iq[])
 {
   //capture usb volume and mute settings
   critical_section_enter_blocking(&usb_volumute);
@@ -507,8 +750,38 @@ void __not_in_flash_func(rx::process_block)(uint16_t adc_samples[], int16_t audi
 
   //process adc IQ samples to produce raw audio
   int16_t usb_audio[adc_block_size/decimation_rate];
-  uint16_t num_samples = rx_dsp_inst.process_block(
-      adc_samples, audio, stream_raw_iq ? &usb_ring_buffer : NULL);
+  int16_t usb_iq[2 * (adc_block_size/cic_decimation_rate)];
+
+  //wideband IQ is written straight into the vendor ring when the host wants
+  //it, otherwise into the local buffer if usb audio needs it
+  int16_t *wideband_iq = NULL;
+  uint8_t vendor_slot = vendor_iq_produced % vendor_iq_ring_size;
+  if(vendor_stream_enabled(VENDOR_FRAME_IQ) && vendor_iq_produced - vendor_iq_consumed < vendor_iq_ring_size)
+  {
+    wideband_iq = vendor_iq[vendor_slot];
+    vendor_iq_block[vendor_slot] = adc_blocks_consumed;
+    vendor_iq_time[vendor_slot] = time_us_32();
+  }
+  else if(usb_stream == STREAM_WIDEBAND_IQ)
+  {
+    wideband_iq = usb_iq;
+  }
+
+  uint16_t num_samples = recorded_iq ?
+      rx_dsp_inst.process_playback_block(
+      recorded_iq, audio,
+      usb_stream == STREAM_IQ ? usb_iq : NULL,
+      wideband_iq) :
+      rx_dsp_inst.process_block(
+      adc_samples, audio,
+      usb_stream == STREAM_IQ ? usb_iq : NULL,
+      wideband_iq);
+
+  if(wideband_iq == vendor_iq[vendor_slot])
+  {
+    __dmb();
+    vendor_iq_produced = vendor_iq_produced + 1;
+  }
   hard_assert(num_samples <= (adc_block_size / decimation_rate));
 
   for(uint16_t idx=0; idx<num_samples; ++idx)
@@ -521,20 +794,111 @@ void __not_in_flash_func(rx::process_block)(uint16_t adc_samples[], int16_t audi
     }
   }
 
-  if (!stream_raw_iq) {
-    // add usb audio to ring buffer
-    int16_t tmp_audio[2 * (adc_block_size / decimation_rate)];
-    for (uint16_t idx = 0; idx < num_samples; idx++) {
-      tmp_audio[2 * idx] = usb_audio[idx];
-      tmp_audio[2 * idx + 1] = usb_audio[idx];
+  #ifdef MEASURE_RESAMPLER
+  const uint32_t resampler_start = time_us_32();
+  #endif
+
+  //resample to the usb rate, audio is mono so only one channel is resampled
+  int16_t tmp_audio[2 * resampler_max_output];
+  uint16_t num_usb_samples;
+  if (usb_stream == STREAM_WIDEBAND_IQ) {
+    const uint16_t num_wideband_samples = adc_block_size / cic_decimation_rate;
+    num_usb_samples = wideband_resampler_i.process(wideband_iq, num_wideband_samples, 2, tmp_audio, 2);
+    wideband_resampler_q.process(wideband_iq + 1, num_wideband_samples, 2, tmp_audio + 1, 2);
+  } else if (usb_stream == STREAM_IQ) {
+    num_usb_samples = usb_resampler_i.process(usb_iq, num_samples, 2, tmp_audio, 2);
+    usb_resampler_q.process(usb_iq + 1, num_samples, 2, tmp_audio + 1, 2);
+  } else {
+    num_usb_samples = usb_resampler_i.process(usb_audio, num_samples, 1, tmp_audio, 2);
+    for (uint16_t idx = 0; idx < num_usb_samples; idx++) {
+      tmp_audio[2 * idx + 1] = tmp_audio[2 * idx];
     }
-    ring_buffer_push_ovr(&usb_ring_buffer, (uint8_t *)tmp_audio,
-                         sizeof(int16_t) * 2 * num_samples);
   }
+
+  #ifdef MEASURE_RESAMPLER
+  static uint32_t resampler_time = 0;
+  static uint16_t resampler_blocks = 0;
+  resampler_time += time_us_32() - resampler_start;
+  if(++resampler_blocks == 256) {
+    printf("resampler %lu cycles per block\n", (uint32_t)(((uint64_t)resampler_time * clock_get_hz(clk_sys)) / (256 * 1000000ull)));
+    resampler_time = 0;
+    resampler_blocks = 0;
+  }
+  #endif
+
+  //count samples overwritten when usb isn't keeping up
+  const uint16_t usb_bytes = usb_frame_bytes * num_usb_samples;
+  const uint16_t usb_free = USB_BUF_SIZE - ring_buffer_get_num_bytes(&usb_ring_buffer);
+  if(usb_bytes > usb_free) usb_dropped_samples = usb_dropped_samples + (usb_bytes - usb_free) / usb_frame_bytes;
+
+  // add usb audio to ring buffer
+  ring_buffer_push_ovr(&usb_ring_buffer, (uint8_t *)tmp_audio, usb_bytes);
 }
 
 
 
+//play a recording from the sd card in place of the adc
+void rx::run_playback()
+{
+    //interval between battery/temperature readings (about 1s)
+    const uint16_t batt_temp_interval = 256;
+    uint16_t batt_temp_count = 0;
+
+    //the adc was stopped deliberately, nothing is dropped
+    restart_pending = false;
+    stream_stop_time = 0;
+    adc_blocks_consumed = 0;
+    pwm_audio_sink_start(false);
+
+    while(true)
+    {
+        update_status();
+        if(settings_changed) apply_settings();
+        if(!playback) break;
+
+        if(suspend)
+        {
+          pwm_audio_sink_stop();
+          while(suspend) update_status();
+          pwm_audio_sink_start(false);
+        }
+
+        //the adc doesn't run, the audio sink sets the pace instead
+        while(pwm_audio_sink_fill() >= pwm_latency) tight_loop_contents();
+
+        if(++batt_temp_count == batt_temp_interval)
+        {
+          batt_temp_count = 0;
+          read_batt_temp();
+        }
+
+        //play silence if the read ahead has run dry
+        int16_t recorded_iq[2 * adc_block_size / cic_decimation_rate];
+        if(!sdcard_read(recorded_iq, 2 * adc_block_size / cic_decimation_rate))
+        {
+          memset(recorded_iq, 0, sizeof(recorded_iq));
+          dropped_blocks++;
+        }
+
+        int16_t audio[PWM_AUDIO_NUM_SAMPLES];
+        uint32_t start_time = time_us_32();
+        process_block(NULL, audio, recorded_iq);
+        pwm_audio_sink_push(audio, gain_numerator);
+        busy_time = time_us_32() - start_time;
+        adc_blocks_consumed++;
+    }
+
+    pwm_audio_sink_stop();
+}
+
+void rx::set_playback(bool enable, double frequency_Hz)
+{
+  access(true);
+  settings_to_apply.playback = enable;
+  settings_to_apply.playback_frequency_Hz = frequency_Hz;
+  release();
+}
+
 void rx::run()
 {
     usb_audio_device_init();
@@ -547,19 +911,33 @@ void rx::run()
     // here the delay theoretically should be 1067 (1ms = 1 / (15000 / 16))
     // however the 'usb_microphone_task' should be called more often, but not too often
     // to save compute
-    bool ret = alarm_pool_add_repeating_timer_us(pool, 1067 / 2, usb_callback, NULL, &usb_timer);
+    bool ret = alarm_pool_add_repeating_timer_us(pool, 1067 / 2, usb_callback, this, &usb_timer);
     hard_assert(ret);
 
+    //nominal duration of one ADC block, used to count blocks lost during a restart
+    const uint32_t block_time_us = (1000000ull * adc_block_size) / adc_sample_rate;
+
+    //interval between in-stream battery/temperature readings (about 1s)
+    const uint16_t batt_temp_interval = 256;
+
+    //initial battery/temperature reading before streaming starts
+    read_batt_temp();
+
     while(true)
     {
       if(settings_changed) apply_settings();
 
+      //a recording on the sd card replaces the adc until playback stops
+      if(playback)
+      {
+        run_playback();
+        continue;
+      }
 
-      //read other adc channels when streaming is not running
-      uint32_t timeout = 15000;
-      read_batt_temp();
+      uint16_t batt_temp_count = 0;
 
       //supress audio output until first block has completed
+      restart_pending = false;
       audio_running = false;
       hw_clear_bits(&adc_hw->fcs, ADC_FCS_UNDER_BITS);
       hw_clear_bits(&adc_hw->fcs, ADC_FCS_OVER_BITS);
@@ -567,26 +945,44 @@ void rx::run()
       adc_fifo_setup(true, true, 1, false, false);
       adc_select_input(0);
       adc_set_round_robin(3);
-      dma_channel_configure(adc_dma_ping, &ping_cfg, ping_samples, &adc_hw->fifo, adc_block_size, false);
-      dma_channel_configure(adc_dma_pong, &pong_cfg, pong_samples, &adc_hw->fifo, adc_block_size, false);
-      dma_channel_set_irq0_enabled(adc_dma_ping, true);
-      dma_channel_set_irq0_enabled(adc_dma_pong, true);
-      dma_start_channel_mask(1u << adc_dma_ping);
+      adc_blocks_produced = 0;
+      adc_blocks_consumed = 0;
+      dma_channel_configure(adc_dma_ctrl, &adc_ctrl_cfg, &dma_hw->ch[adc_dma_data].al2_write_addr_trig, adc_block_addr, 1, false);
+      dma_channel_configure(adc_dma_data, &adc_data_cfg, adc_samples[0], &adc_hw->fifo, adc_block_size, false);
+      dma_channel_set_irq0_enabled(adc_dma_data, true);
+      dma_start_channel_mask(1u << adc_dma_data);
       adc_run(true);
 
       pwm_audio_sink_start();
 
+      if(stream_stop_time)
+      {
+        dropped_blocks += (time_us_32() - stream_stop_time + block_time_us - 1) / block_time_us;
+        stream_stop_time = 0;
+      }
+
       while(true)
       {
           //exchange data with UI (runing in core 0)
           update_status();
 
-          //periodically (or when requested) suspend streaming
-          if(timeout-- == 0 || suspend || settings_changed)
+          //apply DSP settings between blocks without stopping the ADC
+          if(settings_changed) apply_settings();
+
+          //sample battery and temperature without leaving the streaming loop
+          if(++batt_temp_count == batt_temp_interval)
           {
+            batt_temp_count = 0;
+            sample_batt_temp();
+          }
+
+          //stop streaming when suspended or when the PLL is reprogrammed
+          if(suspend || restart_pending)
+          {
+            if(!suspend) stream_stop_time = time_us_32();
 
-            dma_channel_cleanup(adc_dma_ping);
-            dma_channel_cleanup(adc_dma_pong);
+            dma_channel_cleanup(adc_dma_data);
+            dma_channel_cleanup(adc_dma_ctrl);
             pwm_audio_sink_stop();
 
             adc_run(false);
@@ -597,15 +993,24 @@ void rx::run()
           }
 
           //process adc data as each block completes
+          while(adc_blocks_consumed == adc_blocks_produced) tight_loop_contents();
+
+          //if processing has fallen a whole ring behind, the oldest blocks
+          //have been overwritten, skip to the oldest block that is still intact
+          const uint32_t blocks_pending = adc_blocks_produced - adc_blocks_consumed;
+          if(blocks_pending >= adc_ring_size)
+          {
+            adc_overruns += blocks_pending - (adc_ring_size - 1);
+            adc_blocks_consumed += blocks_pending - (adc_ring_size - 1);
+          }
+
+          //the audio sink only queues the block, so this is purely DSP time
           int16_t audio[PWM_AUDIO_NUM_SAMPLES];
-          dma_channel_wait_for_finish_blocking(adc_dma_ping);
           uint32_t start_time = time_us_32();
-          process_block(ping_samples, audio);
-          busy_time = pwm_audio_sink_push(audio, gain_numerator);
-          busy_time -= start_time;
-          dma_channel_wait_for_finish_blocking(adc_dma_pong);
-          process_block(pong_samples, audio);
+          process_block(adc_samples[adc_blocks_consumed % adc_ring_size], audio);
           pwm_audio_sink_push(audio, gain_numerator);
+          busy_time = time_us_32() - start_time;
+          adc_blocks_consumed++;
       }
 
       //suspended state
@@ -16,6 +16,7 @@
 
 #include "rx_definitions.h"
 #include "rx_dsp.h"
+#include "resampler.h"
 
 struct rx_settings
 {
@@ -55,8 +56,10 @@ struct rx_settings
   uint8_t tuning_option;
   uint8_t nn_denoiser;
   bool enable_external_nco;
-  bool stream_raw_iq;
-  bool sd_card_save;
+  uint8_t usb_stream;
+  uint8_t sd_card_save;
+  bool playback;
+  double playback_frequency_Hz;
 };
 
 struct rx_status
@@ -69,8 +72,21 @@ struct rx_status
   uint8_t usb_buf_level;
   uint16_t audio_level;
   float tuning_offset_Hz;
+  uint32_t settings_changes;
+  uint32_t dropped_blocks;
+  uint32_t adc_overruns;
+  uint8_t audio_fill;
+  uint32_t audio_underruns;
+  uint32_t audio_overruns;
+  int16_t audio_rate_ppm;
+  uint32_t usb_dropped_samples;
+  uint32_t usb_duplicated_samples;
+  uint32_t usb_sent_samples;
+  int16_t usb_rate_ppm;
   bool transmitting;
   bool tuned;
+  uint32_t retune_us;   //longest internal nco retune, cleared by the telemetry
+  uint32_t pll_changes;
 };
 
 class rx
@@ -79,6 +95,7 @@ class rx
 
   void update_status();
   void tx_update_status();
+  bool restart_required();
   void set_usb_callbacks();
 
   //receiver configuration
@@ -88,6 +105,7 @@ class rx
   double offset_frequency_Hz;
   semaphore_t settings_semaphore;
   bool settings_changed;
+  volatile bool restart_pending; //set by core 0 when tuning changes the PLL
   bool suspend;
   uint16_t temp;
   uint16_t battery;
@@ -105,21 +123,38 @@ class rx
   static int capture_dma;
   static dma_channel_config capture_cfg;
 
-  //buffers and dma for adc
-  static int adc_dma_ping;
-  static int adc_dma_pong;
-  static dma_channel_config ping_cfg;
-  static dma_channel_config pong_cfg;
-  static uint16_t ping_samples[adc_block_size];
-  static uint16_t pong_samples[adc_block_size];
+  //ring of buffers and dma for adc
+  static_assert(adc_ring_size >= 2 && adc_ring_size <= 8 && !(adc_ring_size & (adc_ring_size - 1)),
+                "adc_ring_size must be 2, 4 or 8");
+  static int adc_dma_data;
+  static int adc_dma_ctrl;
+  static dma_channel_config adc_data_cfg;
+  static dma_channel_config adc_ctrl_cfg;
+  static uint16_t adc_samples[adc_ring_size][adc_block_size];
+  static uint16_t *adc_block_addr[adc_ring_size];
+  static volatile uint32_t adc_blocks_produced;
+  uint32_t adc_blocks_consumed = 0;
+  uint32_t adc_overruns = 0;
 
   static bool audio_running;
   static void dma_handler();
-  void process_block(uint16_t adc_samples[], int16_t audio[]);
+  void process_block(uint16_t adc_samples[], int16_t audio[], const int16_t recorded_iq[] = NULL);
+
+  //sd card playback replaces the adc
+  bool playback = false;
+  void run_playback();
 
   //store busy time for performance monitoring
   uint32_t busy_time;
 
+  //settings last applied by core 1, used to classify changes
+  rx_settings applied_settings;
+
+  //count blocks lost while streaming is stopped for a restart
+  uint32_t settings_changes = 0;
+  uint32_t dropped_blocks = 0;
+  uint32_t stream_stop_time = 0;
+
   alarm_pool_t *pool = NULL;
 
   //volume control
@@ -133,7 +168,16 @@ class rx
   bool internal_nco_active = true;
 
   // USB streaming mode
-  uint8_t stream_raw_iq;
+  uint8_t usb_stream;
+
+  //wideband IQ blocks written by core 1 and sent over the vendor interface
+  static const uint8_t vendor_iq_ring_size = 4u;
+  int16_t vendor_iq[vendor_iq_ring_size][2 * adc_block_size / cic_decimation_rate];
+  uint32_t vendor_iq_block[vendor_iq_ring_size];
+  uint32_t vendor_iq_time[vendor_iq_ring_size];
+  volatile uint32_t vendor_iq_produced = 0;
+  volatile uint32_t vendor_iq_consumed = 0;
+  uint32_t vendor_busy_time = 0;
 
   public:
   rx(rx_settings & settings_to_apply, rx_status & status);
@@ -143,10 +187,17 @@ class rx
   void get_spectrum(uint8_t spectrum[], uint8_t &dB10, uint8_t zoom);
   void get_audio(uint8_t audio[]);
   void set_alarm_pool(alarm_pool_t *p);
+  void vendor_stream_task();
+  void set_playback(bool enable, double frequency_Hz);
   rx_settings &settings_to_apply;
   rx_status &status;
   rx_dsp rx_dsp_inst;
+  resampler usb_resampler_i{resampler_15k_to_48k};
+  resampler usb_resampler_q{resampler_15k_to_48k};
+  resampler wideband_resampler_i{resampler_30k_to_48k};
+  resampler wideband_resampler_q{resampler_30k_to_48k};
   void read_batt_temp();
+  void sample_batt_temp();
   void access(bool settings_changed);
   void release();
   bool get_raw_data(int16_t &i, int16_t &q);
@@ -15,6 +15,9 @@ const uint32_t pwm_audio_sample_rate = adc_sample_rate / 2;
 const uint8_t  adc_bits = 12u;
 const uint16_t adc_max=1<<(adc_bits-1);
 const uint16_t adc_block_size = new_fft_size * cic_decimation_rate;
+const uint8_t  adc_ring_size = 4u; //number of adc blocks buffered by DMA (2, 4 or 8)
+const uint8_t  pwm_ring_size = 4u; //number of audio blocks buffered by PWM DMA (2, 4 or 8)
+const uint8_t  pwm_latency = 2u; //audio blocks queued ahead of the block playing
 const uint8_t  AM = 0u;
 const uint8_t  AMSYNC = 1u;
 const uint8_t  LSB = 2u;
@@ -22,6 +25,18 @@ const uint8_t  USB = 3u;
 const uint8_t  FM = 4u;
 const uint8_t  CW = 5u;
 
+//usb stream modes
+const uint8_t  STREAM_AUDIO = 0u;
+const uint8_t  STREAM_IQ = 1u;          //15kHz IQ after the fft filter
+const uint8_t  STREAM_WIDEBAND_IQ = 2u; //30kHz IQ from the cic decimator
+
+//sd card recording modes
+const uint8_t  SD_RECORD_OFF = 0u;
+const uint8_t  SD_RECORD_AUDIO = 1u;     //15kHz mono audio
+const uint8_t  SD_RECORD_IQ = 2u;        //30kHz stereo IQ from the cic decimator
+const uint8_t  SD_RECORD_AUDIO_ADPCM = 3u; //as SD_RECORD_AUDIO, IMA-ADPCM compressed 4:1
+const uint8_t  SD_RECORD_IQ_LOSSLESS = 4u; //as SD_RECORD_IQ, Rice coded (see codecs/rice_iq.h)
+
 const uint16_t interpolation_rate = decimation_rate/2u;
 const uint16_t extra_bits = 1u;
 const uint8_t  cic_order = 4u;
@@ -211,7 +211,7 @@ void inline rx_dsp :: iq_imbalance_correction(int16_t &i, int16_t &q)
     }
 }
 
-uint16_t __not_in_flash_func(rx_dsp :: process_block)(uint16_t samples[], int16_t audio_samples[], ring_buffer_t *iq_samples)
+uint16_t __not_in_flash_func(rx_dsp :: process_block)(uint16_t samples[], int16_t audio_samples[], int16_t iq_samples[], int16_t wideband_iq_samples[])
 {
 
   uint16_t decimated_index = 0;
@@ -223,6 +223,10 @@ uint16_t __not_in_flash_func(rx_dsp :: process_block)(uint16_t samples[], int16_
       const int16_t raw_sample = samples[idx];
 
       //work out which samples are i and q
+      //q is sampled half a pair period after i. Each rail is fed to the cic
+      //at the full adc rate with zeros in place of the other rail, so every
+      //sample enters the filter at its true sampling instant and no extra
+      //fractional delay is needed (see simulations/iq_skew.py)
       int16_t i = ((idx&1)^1^swap_iq)*raw_sample;//even samples contain i data
       int16_t q = ((idx&1)^swap_iq)*raw_sample;//odd samples contain q data
 
@@ -273,6 +277,42 @@ uint16_t __not_in_flash_func(rx_dsp :: process_block)(uint16_t samples[], int16_
       }
   }
 
+  return process_iq(iq, audio_samples, iq_samples, wideband_iq_samples);
+}
+
+//recorded 30kHz IQ enters the chain after the cic decimator, dc removal and
+//iq correction were applied when it was recorded. Shifting by the offset from
+//the recorded frequency allows retuning within the recorded bandwidth.
+uint16_t __not_in_flash_func(rx_dsp :: process_playback_block)(const int16_t recorded_iq[], int16_t audio_samples[], int16_t iq_samples[], int16_t wideband_iq_samples[])
+{
+  int16_t iq[2 * adc_block_size / cic_decimation_rate];
+  for(uint16_t idx=0; idx<2 * adc_block_size / cic_decimation_rate; idx+=2)
+  {
+    int16_t i = recorded_iq[idx];
+    int16_t q = recorded_iq[idx + 1];
+    frequency_shift(i, q);
+    iq[idx] = i;
+    iq[idx + 1] = q;
+  }
+
+  return process_iq(iq, audio_samples, iq_samples, wideband_iq_samples);
+}
+
+uint16_t __not_in_flash_func(rx_dsp :: process_iq)(int16_t iq[], int16_t audio_samples[], int16_t iq_samples[], int16_t wideband_iq_samples[])
+{
+  //tap the 30kHz IQ before the fft filter for wideband streaming
+  if (wideband_iq_samples) {
+    for (uint16_t idx = 0; idx < 2 * adc_block_size / cic_decimation_rate; idx++) {
+      wideband_iq_samples[idx] = iq[idx];
+    }
+  }
+
+  //record the same 30kHz IQ as interleaved stereo, the squelch state is
+  //from the previous block
+  if (sd_card_save == SD_RECORD_IQ || sd_card_save == SD_RECORD_IQ_LOSSLESS) {
+    sdcard_write((const uint16_t*)iq, 2 * adc_block_size / cic_decimation_rate, squelch_open);
+  }
+
   //fft filter decimates a further 2x
   //if the capture buffer isn't in use, fill it
   filter_control.capture = sem_try_acquire(&spectrum_semaphore);
@@ -319,9 +359,9 @@ uint16_t __not_in_flash_func(rx_dsp :: process_block)(uint16_t samples[], int16_
     audio_samples[idx] = audio;
   }
 
-  if (sd_card_save) {
+  if (sd_card_save == SD_RECORD_AUDIO || sd_card_save == SD_RECORD_AUDIO_ADPCM) {
     sdcard_write((const uint16_t*)audio_samples,
-                 adc_block_size / decimation_rate);
+                 adc_block_size / decimation_rate, squelch_open);
   }
 
   if (sem_try_acquire(&audio_semaphore)) {
@@ -336,9 +376,9 @@ uint16_t __not_in_flash_func(rx_dsp :: process_block)(uint16_t samples[], int16_
   }
 
   if (iq_samples) {
-    ring_buffer_push_ovr(
-        iq_samples, (uint8_t *)iq,
-        2 * sizeof(int16_t) * adc_block_size / decimation_rate);
+    for (uint16_t idx = 0; idx < 2 * adc_block_size / decimation_rate; idx++) {
+      iq_samples[idx] = iq[idx];
+    }
   }
 
   //average over the number of samples
@@ -528,7 +568,8 @@ int16_t __not_in_flash_func(rx_dsp::squelch)(int16_t audio)
       squelch_time_ms = to_ms_since_boot(get_absolute_time());
     const uint32_t time_since_active = to_ms_since_boot(get_absolute_time())-squelch_time_ms;
 
-    if(time_since_active < squelch_timeout_ms)
+    squelch_open = time_since_active < squelch_timeout_ms;
+    if(squelch_open)
     {
       return audio;
     } else {
@@ -660,7 +701,7 @@ void rx_dsp :: set_spectrum_smoothing(uint8_t spectrum_smoothing)
   filter_control.spectrum_smoothing = spectrum_smoothing;
 }
 
-void rx_dsp ::set_sd_card_save(bool enable) { sd_card_save = enable; }
+void rx_dsp ::set_sd_card_save(uint8_t record_mode) { sd_card_save = record_mode; }
 
 void rx_dsp :: set_noise_reduction(bool enable_noise_reduction, int8_t noise_smoothing, int8_t noise_threshold)
 {
@@ -898,6 +939,19 @@ void rx_dsp :: get_spectrum(uint8_t spectrum[], uint8_t &dB10, uint8_t zoom)
   dB10 = 256/(2*logf(max/min));
 }
 
+//direct access to the raw spectrum capture, NULL if core 1 is updating it
+const int16_t *rx_dsp :: try_acquire_capture(int16_t &fft_bin)
+{
+  if(!sem_try_acquire(&spectrum_semaphore)) return NULL;
+  fft_bin = capture_filter_control.fft_bin;
+  return capture;
+}
+
+void rx_dsp :: release_capture()
+{
+  sem_release(&spectrum_semaphore);
+}
+
 static uint16_t __time_critical_func(audio_correlate)(int16_t a[128],
                                                       int16_t b[128]) {
   int32_t s_max = INT32_MIN;
@@ -22,7 +22,8 @@ class rx_dsp
   public:
 
   rx_dsp();
-  uint16_t process_block(uint16_t samples[], int16_t audio_samples[], ring_buffer_t *iq_samples);
+  uint16_t process_block(uint16_t samples[], int16_t audio_samples[], int16_t iq_samples[], int16_t wideband_iq_samples[]);
+  uint16_t process_playback_block(const int16_t recorded_iq[], int16_t audio_samples[], int16_t iq_samples[], int16_t wideband_iq_samples[]);
   void set_frequency_offset_Hz(double offset_frequency);
   void set_agc_control(uint8_t agc_control, uint8_t agc_gain);
   void set_mode(uint8_t mode, uint8_t bw);
@@ -39,12 +40,14 @@ class rx_dsp
   void set_nn_denoiser(uint8_t val);
   void set_noise_reduction(bool enable_noise_reduction, int8_t noise_smoothing, int8_t noise_threshold);
   void set_spectrum_smoothing(uint8_t spectrum_smoothing);
-  void set_sd_card_save(bool enable);
+  void set_sd_card_save(uint8_t record_mode);
   int16_t get_signal_strength_dBm();
   void get_spectrum(uint8_t spectrum[], uint8_t &dB10, uint8_t zoom);
   void get_audio_capture(uint8_t audio[]);
   s_filter_control get_filter_config();
   void get_spectrum(float spectrum[]);
+  const int16_t *try_acquire_capture(int16_t &fft_bin);
+  void release_capture();
   bool get_raw_data(int16_t &i, int16_t &q);
   uint32_t get_iq_buffer_level();
   float get_tuning_offset_Hz();
@@ -52,6 +55,7 @@ class rx_dsp
 
   private:
 
+  uint16_t process_iq(int16_t iq[], int16_t audio_samples[], int16_t iq_samples[], int16_t wideband_iq_samples[]);
   void frequency_shift(int16_t &i, int16_t &q);
   bool decimate(int16_t &i, int16_t &q);
   int16_t demodulate(int16_t i, int16_t q, uint16_t mag, int16_t phi);
@@ -133,6 +137,7 @@ class rx_dsp
   int16_t s9_threshold=0;
   uint32_t squelch_time_ms = 0;
   uint32_t squelch_timeout_ms = 0;
+  bool squelch_open = true;
 
   //used in AGC
   uint8_t attack_factor;
@@ -151,7 +156,7 @@ class rx_dsp
   // synchronous AM demodulator state
   amsync_t amsync;
 
-  bool sd_card_save;
+  uint8_t sd_card_save;
 
 };
 
@@ -5,14 +5,70 @@
 #include "hw_config.h"
 #include "ring_buffer_lib.h"
 #include "utils.h"
+#include "rx_definitions.h"
+#include "codecs/ima_adpcm.h"
+#include "codecs/rice_iq.h"
+#include "codecs/recording_reader.h"
 
-#define SD_BLOCK_SIZE \
-  (1024)  // must be multiple of 512 for maximum FAT32 write speed
+#include "pico/util/queue.h"
 
-// from time to time (~5 minutes with a 16GB card) the write
-// speed slows down by a factor of 100, or more
-// and only with this buffer size we can accommodate
-#define BUF_SIZE (30 * SD_BLOCK_SIZE)
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define SD_SECTOR_SIZE (512)
+
+// data is written in multi-sector transfers, the wav header is padded to a
+// whole sector so that every transfer is sector aligned and FatFs can pass
+// it straight to the card without copying through its sector buffer
+#define SD_WRITE_SIZE (16 * SD_SECTOR_SIZE)
+
+// recordings are pre-allocated as one contiguous run of clusters so the FAT
+// is not touched while recording. Allocation stalls used to slow writes down
+// by a factor of 100 or more. If the card has no contiguous space of this
+// size, smaller sizes are tried before falling back to a growing file.
+#define SD_PREALLOCATE_BYTES (256UL * 1024 * 1024)
+#define SD_PREALLOCATE_MIN_BYTES (16UL * 1024 * 1024)
+
+// headroom for card stalls, the high water mark of each recording is
+// logged to rec_stats.csv to check this is sufficient. Samples are encoded
+// before they enter the buffer, so the compressed modes ride out
+// proportionally longer stalls.
+#define BUF_SIZE (32 * 1024)
+
+// update the header and sync the directory entry every ~1MB
+#define SD_SYNC_BYTES (1024UL * 1024)
+
+// time-shift keeps the last few minutes in a ring of pre-allocated segment
+// files, each a complete recording with its header written once when the
+// segment is allocated. Committing renames the segments, nothing is copied.
+#define SD_TIMESHIFT_SEGMENT_SECONDS (30)
+#define SD_TIMESHIFT_MAX_MINUTES (10)
+#define SD_TIMESHIFT_MAX_SEGMENTS (2 * SD_TIMESHIFT_MAX_MINUTES + 1)
+
+// squelch gated recordings open a file each time the squelch opens. The
+// last blocks before it opens are held unencoded so the start of the
+// transmission is kept, about 0.5s of audio or 0.14s of IQ. Files are
+// pre-allocated in smaller steps as most are short.
+#define SD_PREROLL_SAMPLES (8192)
+#define SD_SEGMENT_PREALLOCATE_BYTES (4UL * 1024 * 1024)
+
+// band-occupancy survey, records appended to survey_NNN.bin. The file starts
+// with "PSRV", version and record header size. Each band (a panorama survey
+// band, or the live spectrum while listening) gets one record per interval,
+// and a new one when its range changes. A record is a 26 byte header (seconds
+// since the last record, sweeps averaged, floor in dB, band, longest time in
+// us spent accumulating a sweep, the time in us taken to quantise and write
+// the previous records, channels, fft_bin, tuned, start and stop frequency)
+// then one byte per channel: average level above the floor in the high nibble
+// and peak above average in the low nibble, both in 3dB steps. See
+// utils/survey_to_csv.py.
+#define SD_SURVEY_VERSION (2)
+#define SD_SURVEY_RECORD_HEADER (26)
+#define SD_SURVEY_MAX_CHANNELS (256)
+#define SD_SURVEY_STEP_DB (3)
+// a range left sooner than this (tuning through) is not recorded
+#define SD_SURVEY_MIN_RECORD_MS (1000)
 
 // #define SD_DBG
 
@@ -25,12 +81,6 @@
   } while (0)
 #endif
 
-static const uint8_t wav_header[44] = {
-    0x52, 0x49, 0x46, 0x46, 0x18, 0x20, 0xe9, 0x02, 0x57, 0x41, 0x56,
-    0x45, 0x66, 0x6d, 0x74, 0x20, 0x10, 0x00, 0x00, 0x00, 0x01, 0x00,
-    0x01, 0x00, 0x98, 0x3a, 0x00, 0x00, 0x30, 0x75, 0x00, 0x00, 0x02,
-    0x00, 0x10, 0x00, 0x64, 0x61, 0x74, 0x61, 0x00, 0x00, 0x00, 0x00};
-
 static sd_sdio_if_t sdio_if = {
     .CMD_gpio = 12,
     .D0_gpio = 7,
@@ -54,59 +104,282 @@ sd_card_t* sd_get_by_num(size_t num) {
 }
 
 static bool card_mounted = false;
-static bool writing_enabled = false;
+static volatile bool writing_enabled = false;
 static FIL file;
 static uint32_t f_count;
 static uint32_t b_count;
+static uint32_t bytes_since_sync;
 static ring_buffer_t sdcard_rb;
 static uint8_t usb_buf[BUF_SIZE];
 static FATFS fs;
+static char filename[32];
+
+// encoders run on core 1 as each block arrives, cost is bounded per sample
+static uint8_t active_record_mode = SD_RECORD_OFF;
+static ima_adpcm_encoder adpcm_encoder;
+static const uint16_t iq_frame_pairs = adc_block_size / cic_decimation_rate;
+static uint8_t iq_frame[2 + iq_frame_pairs * 4];
 
-static void update_wav_size(void) {
+// playback shares the file and ring buffer, it can't run while recording
+static volatile bool playback_enabled = false;
+static recording_reader reader;
+static uint32_t playback_underruns;
+
+// time-shift ring, segments are allocated as the ring first reaches them
+static volatile bool timeshift_enabled = false;
+static uint8_t segment_count;
+static uint8_t segment_index;
+static uint32_t segment_size;
+static uint32_t segment_allocated;
+static uint32_t segment_bytes[SD_TIMESHIFT_MAX_SEGMENTS];
+static uint32_t timeshift_written_bytes;
+static uint32_t timeshift_metadata_sectors;
+
+// squelch gate, the state is owned by core 1 while recording. Core 1 queues
+// the length of each segment when the gate closes, core 0 closes the file
+// once that many bytes are written.
+struct segment_event {
+  uint32_t bytes;
+  uint32_t start_ms;
+  uint32_t end_ms;
+};
+static queue_t segment_queue;
+static volatile bool gated = false;
+static uint16_t gate_hang_ms;
+static bool gate_open;
+static uint32_t gate_last_open_ms;
+static uint32_t gate_start_ms;
+static uint32_t gate_bytes;
+static int16_t preroll[SD_PREROLL_SAMPLES];
+static uint16_t preroll_blocks;
+static uint16_t preroll_next;
+
+// core 0 side of the current segment
+static bool segment_open = false;
+static uint32_t segment_start_ms;
+static uint32_t segment_frequency;
+static uint8_t segment_mode;
+static int16_t segment_peak_dBm;
+static volatile uint32_t channel_frequency;
+static volatile uint8_t channel_mode;
+static volatile int16_t channel_signal_dBm;
+
+// per-recording statistics, written to rec_stats.csv when recording stops
+static uint32_t start_time_ms;
+static uint32_t preallocated_bytes;
+static uint32_t max_write_us;
+static volatile uint32_t high_water;
+static volatile uint32_t overrun_bytes;
+
+static void make_header(uint8_t header[SD_SECTOR_SIZE], uint16_t channels,
+                        uint32_t sample_rate, uint32_t data_bytes) {
+  auto put16 = [&](uint16_t offset, uint16_t value) {
+    header[offset] = value;
+    header[offset + 1] = value >> 8;
+  };
+  auto put32 = [&](uint16_t offset, uint32_t value) {
+    put16(offset, value);
+    put16(offset + 2, value >> 16);
+  };
+
+  memset(header, 0, SD_SECTOR_SIZE);
+
+  // lossless IQ uses its own container, see utils/decode_recording.py
+  if (active_record_mode == SD_RECORD_IQ_LOSSLESS) {
+    memcpy(header, "PRIQ", 4);
+    put16(4, 1);  // version
+    put32(6, sample_rate);
+    put16(10, channels);
+    put16(12, iq_frame_pairs);
+    put32(14, data_bytes);
+    return;
+  }
+
+  uint16_t offset = 36;
+  memcpy(header, "RIFF", 4);
+  put32(4, SD_SECTOR_SIZE - 8 + data_bytes);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  if (active_record_mode == SD_RECORD_AUDIO_ADPCM) {
+    const uint16_t block_size = ima_adpcm_encoder::block_size;
+    const uint16_t samples_per_block = ima_adpcm_encoder::samples_per_block;
+    put32(16, 20);
+    put16(20, 0x11);  // IMA-ADPCM
+    put16(22, channels);
+    put32(24, sample_rate);
+    put32(28, sample_rate * block_size / samples_per_block);
+    put16(32, block_size);
+    put16(34, 4);
+    put16(36, 2);
+    put16(38, samples_per_block);
+    // compressed formats need the total sample count
+    memcpy(header + 40, "fact", 4);
+    put32(44, 4);
+    put32(48, data_bytes / block_size * samples_per_block);
+    offset = 52;
+  } else {
+    put32(16, 16);
+    put16(20, 1);  // PCM
+    put16(22, channels);
+    put32(24, sample_rate);
+    put32(28, sample_rate * channels * 2);
+    put16(32, channels * 2);
+    put16(34, 16);
+  }
+  // pad the header to a whole sector, readers skip unknown chunks
+  memcpy(header + offset, "JUNK", 4);
+  put32(offset + 4, SD_SECTOR_SIZE - offset - 8 - 8);
+  memcpy(header + SD_SECTOR_SIZE - 8, "data", 4);
+  put32(SD_SECTOR_SIZE - 4, data_bytes);
+}
+
+static uint16_t wav_channels = 1;
+static uint32_t wav_sample_rate = audio_sample_rate;
+
+static void update_header(void) {
+  uint8_t header[SD_SECTOR_SIZE];
   unsigned int bw;
-  FRESULT fr = f_lseek(&file, 40);
+  make_header(header, wav_channels, wav_sample_rate, b_count);
+  const FSIZE_t position = f_tell(&file);
+  FRESULT fr = f_lseek(&file, 0);
   if (fr != FR_OK) {
     SD_DBG_PRINTF("seek failed: %d", fr);
     return;
   }
-  fr = f_write(&file, &b_count, sizeof(b_count), &bw);
+  fr = f_write(&file, header, SD_SECTOR_SIZE, &bw);
   if (fr != FR_OK) {
     SD_DBG_PRINTF("write failed: %d", fr);
     return;
   }
-  fr = f_lseek(&file, f_size(&file));
+  fr = f_lseek(&file, position);
   if (fr != FR_OK) {
     SD_DBG_PRINTF("seek failed: %d", fr);
     return;
   }
 }
 
-bool sdcard_init(uint32_t c) {
-  f_count = c + 1;
-  FRESULT fr = f_mount(&fs, "", 1);
-  if (FR_OK == fr) {
-    int sl = spin_lock_claim_unused(true);
-    ring_buffer_init(&sdcard_rb, usb_buf, BUF_SIZE, sl);
-    card_mounted = true;
-  } else {
-    SD_DBG_PRINTF("mount failed: %d", fr);
+static void write_stats(void) {
+  FIL stats;
+  FRESULT fr = f_open(&stats, "rec_stats.csv", FA_OPEN_APPEND | FA_WRITE);
+  if (fr != FR_OK) {
+    SD_DBG_PRINTF("stats open failed: %d", fr);
+    return;
   }
-  return card_mounted;
+  char line[128];
+  unsigned int bw;
+  if (f_size(&stats) == 0) {
+    const char *columns = "file,bytes,seconds,preallocated,max_write_us,high_water,buffer_size,overrun_bytes\r\n";
+    f_write(&stats, columns, strlen(columns), &bw);
+  }
+  const int length = snprintf(line, sizeof(line), "%s,%lu,%lu,%lu,%lu,%lu,%u,%lu\r\n",
+                              filename, b_count, (time_us_32() / 1000 - start_time_ms) / 1000,
+                              preallocated_bytes, max_write_us, high_water, BUF_SIZE, overrun_bytes);
+  f_write(&stats, line, length, &bw);
+  f_close(&stats);
+  SD_DBG_PRINTF("%s", line);
 }
 
-uint32_t sdcard_start_recording(uint32_t frequency, uint8_t mode) {
-  if (!card_mounted) {
-    return f_count;
+static void segment_name(char name[], uint8_t index) {
+  snprintf(name, 16, "ts_%02u.tmp", index);
+}
+
+// open the segment at segment_index, allocating it the first time around
+static bool open_segment(void) {
+  char name[16];
+  segment_name(name, segment_index);
+  b_count = 0;
+  if (segment_allocated & (1UL << segment_index)) {
+    // the header already describes a full segment, only the data is rewritten
+    if (f_open(&file, name, FA_OPEN_EXISTING | FA_WRITE) != FR_OK) {
+      return false;
+    }
+    if (f_lseek(&file, SD_SECTOR_SIZE) != FR_OK) {
+      f_close(&file);
+      return false;
+    }
+    return true;
   }
 
-  if (writing_enabled) {
+  FRESULT fr = f_open(&file, name, FA_CREATE_ALWAYS | FA_WRITE);
+  if (fr != FR_OK) {
+    SD_DBG_PRINTF("segment open failed: %d", fr);
+    return false;
+  }
+  fr = f_expand(&file, SD_SECTOR_SIZE + segment_size, 1);
+  if (fr != FR_OK) {
+    SD_DBG_PRINTF("segment expand failed: %d", fr);
+  }
+  uint8_t header[SD_SECTOR_SIZE];
+  unsigned int bw;
+  make_header(header, wav_channels, wav_sample_rate, segment_size);
+  fr = f_write(&file, header, SD_SECTOR_SIZE, &bw);
+  if (fr != FR_OK) {
     f_close(&file);
+    return false;
+  }
+  segment_allocated |= 1UL << segment_index;
+  timeshift_metadata_sectors++;
+  return true;
+}
+
+// move on to the oldest segment once the current one is full
+static void next_segment(void) {
+  segment_bytes[segment_index] = b_count;
+  // the directory entry is updated on close
+  f_close(&file);
+  timeshift_metadata_sectors++;
+  segment_index = (segment_index + 1) % segment_count;
+  segment_bytes[segment_index] = 0;
+  if (!open_segment()) {
+    timeshift_enabled = false;
+    writing_enabled = false;
+  }
+}
+
+// write all complete transfers, or everything if final is set, taking at
+// most limit bytes from the buffer
+static void write_buffered(bool final, uint32_t limit = UINT32_MAX) {
+  static uint8_t buf[SD_WRITE_SIZE] __attribute__((aligned(4)));
+  const uint32_t start = time_us_32();
+  uint32_t b = std::min<uint32_t>(ring_buffer_get_num_bytes(&sdcard_rb), limit);
+  while ((b >= SD_WRITE_SIZE || (final && b)) &&
+         ((time_us_32() - start) < 1800000)) {
+    const uint16_t n = ring_buffer_pop(&sdcard_rb, buf, std::min<uint32_t>(b, SD_WRITE_SIZE));
+    unsigned int bw;
+    const uint32_t tm = time_us_32();
+    FRESULT fr = f_write(&file, buf, n, &bw);
+    const uint32_t dur = time_us_32() - tm;
+    max_write_us = std::max(max_write_us, dur);
+    if (dur > 20000) {
+      SD_DBG_PRINTF("w: %d %ld %d %ld %ld", fr, b, bw, dur,
+                    time_us_32() - start);
+    }
+    if (FR_OK == fr) {
+      b_count += bw;
+      bytes_since_sync += bw;
+    } else {
+      SD_DBG_PRINTF("write error: %d", fr);
+    }
+    b -= n;
+    if (timeshift_enabled) {
+      timeshift_written_bytes += bw;
+      // segments are a whole number of transfers, so they fill exactly
+      if (b_count >= segment_size) {
+        next_segment();
+        if (!timeshift_enabled) {
+          return;
+        }
+      }
+    }
   }
+}
 
+// opens the next numbered recording and writes a provisional header
+static bool open_recording(uint32_t frequency, uint8_t mode, uint32_t preallocate) {
+  const bool iq = active_record_mode == SD_RECORD_IQ || active_record_mode == SD_RECORD_IQ_LOSSLESS;
   while (true) {
-    char filename[32];
-    snprintf(filename, sizeof(filename), "rec_%06ld_%ld_%s.wav", f_count,
-             frequency, mode_to_str(mode));
+    snprintf(filename, sizeof(filename), "rec_%06ld_%ld_%s.%s", f_count,
+             frequency, iq ? "IQ" : mode_to_str(mode),
+             active_record_mode == SD_RECORD_IQ_LOSSLESS ? "riq" : "wav");
     FRESULT fr = f_open(&file, filename, FA_CREATE_NEW | FA_WRITE);
     if (FR_EXIST == fr) {
       f_count++;
@@ -115,84 +388,784 @@ uint32_t sdcard_start_recording(uint32_t frequency, uint8_t mode) {
       }
     } else if (FR_OK == fr) {
       SD_DBG_PRINTF("Opening file: %s", filename);
+
+      // reserve contiguous clusters, the unused tail is released on stop
+      preallocated_bytes = 0;
+      for (uint32_t size = preallocate; size >= std::min<uint32_t>(preallocate, SD_PREALLOCATE_MIN_BYTES); size >>= 1) {
+        if (f_expand(&file, size, 1) == FR_OK) {
+          preallocated_bytes = size;
+          break;
+        }
+      }
+
+      uint8_t header[SD_SECTOR_SIZE];
       unsigned int bw;
-      fr = f_write(&file, wav_header, 44, &bw);
-      writing_enabled = true;
+      make_header(header, wav_channels, wav_sample_rate, 0);
+      fr = f_write(&file, header, SD_SECTOR_SIZE, &bw);
+
       b_count = 0;
+      bytes_since_sync = 0;
       f_count++;
       if (f_count == 999999) {
         f_count = 0;
       }
-      break;
+      return true;
     } else {
-      break;
+      return false;
     }
   }
+}
 
-  return f_count;
+// release the unused part of the pre-allocation and finish the header
+static void close_recording(void) {
+  FRESULT fr = f_truncate(&file);
+  if (fr != FR_OK) {
+    SD_DBG_PRINTF("truncate failed: %d", fr);
+  }
+  update_header();
+  fr = f_close(&file);
+  if (fr != FR_OK) {
+    SD_DBG_PRINTF("close failed: %d", fr);
+  }
 }
 
-void sdcard_stop_recording(void) {
-  if (!card_mounted) {
+// one line per squelch gated segment, there is no clock so times are
+// milliseconds since power on
+static void write_index(const segment_event& event) {
+  FIL index;
+  FRESULT fr = f_open(&index, "rec_index.csv", FA_OPEN_APPEND | FA_WRITE);
+  if (fr != FR_OK) {
+    SD_DBG_PRINTF("index open failed: %d", fr);
     return;
   }
+  char line[128];
+  unsigned int bw;
+  if (f_size(&index) == 0) {
+    const char *columns = "file,start_ms,duration_ms,frequency,mode,peak_dBm,bytes\r\n";
+    f_write(&index, columns, strlen(columns), &bw);
+  }
+  const int length = snprintf(line, sizeof(line), "%s,%lu,%lu,%lu,%s,%d,%lu\r\n",
+                              filename, event.start_ms, event.end_ms - event.start_ms,
+                              segment_frequency, mode_to_str(segment_mode),
+                              segment_peak_dBm, b_count);
+  f_write(&index, line, length, &bw);
+  f_close(&index);
+  SD_DBG_PRINTF("%s", line);
+}
+
+static void open_segment_file(void) {
+  segment_frequency = channel_frequency;
+  segment_mode = channel_mode;
+  segment_peak_dBm = channel_signal_dBm;
+  segment_start_ms = time_us_32() / 1000;
+  segment_open = open_recording(segment_frequency, segment_mode, SD_SEGMENT_PREALLOCATE_BYTES);
+}
+
+static void close_segment(const segment_event& event) {
+  close_recording();
+  write_index(event);
+  segment_open = false;
+}
+
+bool sdcard_init(uint32_t c) {
+  f_count = c + 1;
+  queue_init(&segment_queue, sizeof(segment_event), 8);
+  FRESULT fr = f_mount(&fs, "", 1);
+  if (FR_OK == fr) {
+    int sl = spin_lock_claim_unused(true);
+    ring_buffer_init(&sdcard_rb, usb_buf, BUF_SIZE, sl);
+    card_mounted = true;
+  } else {
+    SD_DBG_PRINTF("mount failed: %d", fr);
+  }
+  return card_mounted;
+}
+
+static void set_record_mode(uint8_t record_mode) {
+  active_record_mode = record_mode;
+  const bool iq = record_mode == SD_RECORD_IQ || record_mode == SD_RECORD_IQ_LOSSLESS;
+  wav_channels = iq ? 2 : 1;
+  wav_sample_rate = iq ? adc_sample_rate / cic_decimation_rate : audio_sample_rate;
+  adpcm_encoder.reset();
+}
+
+static void discard_buffered(void) {
+  uint8_t discard[64];
+  while (ring_buffer_pop(&sdcard_rb, discard, sizeof(discard)));
+}
 
-  update_wav_size();
-  FRESULT fr = f_close(&file);
+static void write_timeshift_stats(const char* first, uint8_t parts, uint32_t committed_bytes) {
+  FIL stats;
+  FRESULT fr = f_open(&stats, "ts_stats.csv", FA_OPEN_APPEND | FA_WRITE);
   if (fr != FR_OK) {
-    SD_DBG_PRINTF("close failed: %d", fr);
+    SD_DBG_PRINTF("stats open failed: %d", fr);
+    return;
   }
+  char line[160];
+  unsigned int bw;
+  if (f_size(&stats) == 0) {
+    const char *columns = "file,parts,committed_bytes,segment_bytes,written_bytes,metadata_sectors,seconds,max_write_us,high_water,buffer_size,overrun_bytes\r\n";
+    f_write(&stats, columns, strlen(columns), &bw);
+  }
+  const int length = snprintf(line, sizeof(line), "%s,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%u,%lu\r\n",
+                              first, parts, committed_bytes, segment_size, timeshift_written_bytes,
+                              timeshift_metadata_sectors, (time_us_32() / 1000 - start_time_ms) / 1000,
+                              max_write_us, high_water, BUF_SIZE, overrun_bytes);
+  f_write(&stats, line, length, &bw);
+  f_close(&stats);
+  SD_DBG_PRINTF("%s", line);
 }
 
-void sdcard_write(uint16_t const* const data, uint16_t n) {
-  ring_buffer_push_ovr(&sdcard_rb, (uint8_t*)data, 2 * n);
+// turn the ring into numbered parts, oldest first, by renaming the segment
+// files. Only the header and directory entries are written.
+static void commit_timeshift(uint32_t frequency, uint8_t mode) {
+  timeshift_enabled = false;
+  segment_bytes[segment_index] = b_count;
+  f_truncate(&file);
+  update_header();
+  f_close(&file);
+  timeshift_metadata_sectors += 2;
+
+  const bool iq = active_record_mode == SD_RECORD_IQ;
+  char first[32] = "";
+  uint8_t parts = 0;
+  uint32_t committed_bytes = 0;
+  for (uint8_t idx = 1; idx <= segment_count; idx++) {
+    const uint8_t segment = (segment_index + idx) % segment_count;
+    if (!(segment_allocated & (1UL << segment))) {
+      continue;
+    }
+    char name[16];
+    segment_name(name, segment);
+    if (!segment_bytes[segment]) {
+      f_unlink(name);
+      continue;
+    }
+    snprintf(filename, sizeof(filename), "rec_%06ld_%ld_%s_%02u.wav", f_count,
+             frequency, iq ? "IQ" : mode_to_str(mode), parts + 1);
+    FRESULT fr = f_rename(name, filename);
+    if (fr != FR_OK) {
+      SD_DBG_PRINTF("rename failed: %d", fr);
+      f_unlink(name);
+      continue;
+    }
+    if (!parts) {
+      strcpy(first, filename);
+    }
+    parts++;
+    committed_bytes += segment_bytes[segment];
+    timeshift_metadata_sectors++;
+  }
+  segment_allocated = 0;
+  write_timeshift_stats(first, parts, committed_bytes);
 }
 
-bool sdcard_needs_flush(void) {
+uint32_t sdcard_get_counter(void) { return f_count; }
+
+uint32_t sdcard_start_recording(uint32_t frequency, uint8_t mode, uint8_t record_mode, uint16_t squelch_hang_ms) {
   if (!card_mounted) {
+    return f_count;
+  }
+
+  // when the format matches, the recording carries on from the time-shift
+  // ring without a gap, the RAM buffer holds what arrives meanwhile
+  bool continuing = false;
+  if (timeshift_enabled) {
+    continuing = active_record_mode == record_mode && !squelch_hang_ms;
+    if (!continuing) {
+      // the ring holds the last moments before the trigger, keep them
+      writing_enabled = false;
+      write_buffered(true);
+    }
+    commit_timeshift(frequency, mode);
+  }
+
+  if (writing_enabled && !continuing) {
+    sdcard_stop_recording();
+  }
+
+  if (playback_enabled) {
+    return f_count;
+  }
+
+  if (!continuing) {
+    set_record_mode(record_mode);
+    // discard anything left over from a previous recording
+    discard_buffered();
+  }
+
+  max_write_us = 0;
+  high_water = 0;
+  overrun_bytes = 0;
+  start_time_ms = time_us_32() / 1000;
+
+  // files are opened on core 0 as core 1 opens the gate
+  if (squelch_hang_ms) {
+    gate_hang_ms = squelch_hang_ms;
+    gate_open = false;
+    gate_bytes = 0;
+    preroll_blocks = 0;
+    preroll_next = 0;
+    segment_open = false;
+    segment_event event;
+    while (queue_try_remove(&segment_queue, &event));
+    channel_frequency = frequency;
+    channel_mode = mode;
+    gated = true;
+    writing_enabled = true;
+    return f_count;
+  }
+
+  gated = false;
+  writing_enabled = open_recording(frequency, mode, SD_PREALLOCATE_BYTES);
+  return f_count;
+}
+
+// capture continuously into a ring holding at least the last minutes,
+// committed when a recording starts
+bool sdcard_start_timeshift(uint8_t record_mode, uint8_t minutes) {
+  sdcard_stop_timeshift();
+  if (!card_mounted || writing_enabled || playback_enabled || record_mode == SD_RECORD_OFF) {
+    return false;
+  }
+
+  // rice frames would straddle segment boundaries, capture plain IQ instead
+  if (record_mode == SD_RECORD_IQ_LOSSLESS) {
+    record_mode = SD_RECORD_IQ;
+  }
+  set_record_mode(record_mode);
+  uint32_t bytes_per_second = wav_sample_rate * wav_channels * 2;
+  if (record_mode == SD_RECORD_AUDIO_ADPCM) {
+    bytes_per_second = wav_sample_rate * ima_adpcm_encoder::block_size / ima_adpcm_encoder::samples_per_block;
+  }
+  segment_size = bytes_per_second * SD_TIMESHIFT_SEGMENT_SECONDS;
+  segment_size = (segment_size + SD_WRITE_SIZE - 1) / SD_WRITE_SIZE * SD_WRITE_SIZE;
+
+  // one more than needed, the newest segment is only partly filled
+  minutes = std::min<uint8_t>(std::max<uint8_t>(minutes, 1), SD_TIMESHIFT_MAX_MINUTES);
+  segment_count = minutes * 60 / SD_TIMESHIFT_SEGMENT_SECONDS + 1;
+  segment_index = 0;
+  segment_allocated = 0;
+  memset(segment_bytes, 0, sizeof(segment_bytes));
+  timeshift_written_bytes = 0;
+  timeshift_metadata_sectors = 0;
+  if (!open_segment()) {
     return false;
+  }
+
+  discard_buffered();
+  bytes_since_sync = 0;
+  max_write_us = 0;
+  high_water = 0;
+  overrun_bytes = 0;
+  start_time_ms = time_us_32() / 1000;
+  timeshift_enabled = true;
+  writing_enabled = true;
+  return true;
+}
+
+// discards the ring
+void sdcard_stop_timeshift(void) {
+  if (!timeshift_enabled) {
+    return;
+  }
+  timeshift_enabled = false;
+  writing_enabled = false;
+  f_close(&file);
+  for (uint8_t segment = 0; segment < segment_count; segment++) {
+    if (segment_allocated & (1UL << segment)) {
+      char name[16];
+      segment_name(name, segment);
+      f_unlink(name);
+    }
+  }
+  segment_allocated = 0;
+}
+
+void sdcard_stop_recording(void) {
+  if (!card_mounted || !writing_enabled || timeshift_enabled) {
+    return;
+  }
+
+  writing_enabled = false;
+  if (gated) {
+    // finish the segment in progress, a partial one ends here
+    gated = false;
+    if (!segment_open && ring_buffer_get_num_bytes(&sdcard_rb)) {
+      open_segment_file();
+    }
+    if (!segment_open) {
+      return;
+    }
+    segment_event event;
+    const bool ending = queue_try_peek(&segment_queue, &event);
+    write_buffered(true, ending ? event.bytes - b_count : UINT32_MAX);
+    if (!ending) {
+      event.start_ms = segment_start_ms;
+      event.end_ms = time_us_32() / 1000;
+    }
+    close_segment(event);
+    return;
+  }
+
+  write_buffered(true);
+  close_recording();
+  write_stats();
+}
+
+// all or nothing, a block that does not fit is dropped and counted
+static void push_block(const uint8_t* data, uint32_t bytes) {
+  const uint32_t level = ring_buffer_get_num_bytes(&sdcard_rb);
+  if (level + bytes > BUF_SIZE) {
+    overrun_bytes += bytes;
+    return;
+  }
+  ring_buffer_push(&sdcard_rb, data, bytes);
+  gate_bytes += bytes;
+  if (level + bytes > high_water) {
+    high_water = level + bytes;
+  }
+}
+
+static void encode_block(uint16_t const* const data, uint16_t n) {
+  if (active_record_mode == SD_RECORD_AUDIO_ADPCM) {
+    // a partial block at the end of the recording is discarded
+    for (uint16_t idx = 0; idx < n; idx++) {
+      if (adpcm_encoder.push(data[idx])) {
+        push_block(adpcm_encoder.get_block(), ima_adpcm_encoder::block_size);
+      }
+    }
+  } else if (active_record_mode == SD_RECORD_IQ_LOSSLESS) {
+    // one frame per call, the frame size is fixed by the header
+    if (n != 2 * iq_frame_pairs) {
+      return;
+    }
+    const uint16_t bytes = rice_iq_encode((const int16_t*)data, iq_frame_pairs, iq_frame);
+    push_block(iq_frame, bytes);
   } else {
-    return ring_buffer_get_num_bytes(&sdcard_rb) >= SD_BLOCK_SIZE;
+    push_block((const uint8_t*)data, 2 * n);
   }
 }
 
-void sdcard_flush(void) {
-  static uint16_t fc = 0;
-  unsigned int bw;
-  FRESULT fr;
-  static uint8_t buf[SD_BLOCK_SIZE];
+// blocks are held in the pre-roll while the gate is shut, when it opens
+// they are encoded ahead of the live block
+static void gate_block(uint16_t const* const data, uint16_t n, bool squelch_open) {
+  const uint32_t now_ms = time_us_32() / 1000;
+  if (squelch_open) {
+    gate_last_open_ms = now_ms;
+  }
 
-  if (!card_mounted) {
+  if (!gate_open) {
+    const uint16_t capacity = SD_PREROLL_SAMPLES / n;
+    if (!squelch_open) {
+      memcpy(preroll + preroll_next * n, data, 2 * n);
+      preroll_next = (preroll_next + 1) % capacity;
+      preroll_blocks = std::min<uint16_t>(preroll_blocks + 1, capacity);
+      return;
+    }
+    gate_open = true;
+    gate_start_ms = now_ms;
+    gate_bytes = 0;
+    adpcm_encoder.reset();
+    for (uint16_t block = preroll_blocks; block > 0; block--) {
+      const uint16_t idx = (preroll_next + capacity - block) % capacity;
+      encode_block((const uint16_t*)preroll + idx * n, n);
+    }
+    preroll_blocks = 0;
+  }
+
+  encode_block(data, n);
+  if (!squelch_open && now_ms - gate_last_open_ms >= gate_hang_ms) {
+    // a partial ADPCM block is dropped, the segment ends on a whole block
+    const segment_event event = {gate_bytes, gate_start_ms, now_ms};
+    if (!queue_try_add(&segment_queue, &event)) {
+      // core 0 has fallen behind, carry on into the same segment
+      return;
+    }
+    gate_open = false;
+  }
+}
+
+// called from core 1 with one block of samples
+void sdcard_write(uint16_t const* const data, uint16_t n, bool squelch_open) {
+  if (!writing_enabled) {
     return;
   }
+  if (gated) {
+    gate_block(data, n, squelch_open);
+  } else {
+    encode_block(data, n);
+  }
+}
 
-  if (writing_enabled) {
-    int32_t b = ring_buffer_get_num_bytes(&sdcard_rb);
-    const uint32_t start = time_us_32();
-    while ((b >= SD_BLOCK_SIZE) && ((time_us_32() - start) < 1800000)) {
-      uint32_t tm = time_us_32();
-      ring_buffer_pop(&sdcard_rb, buf, SD_BLOCK_SIZE);
-      fr = f_write(&file, buf, SD_BLOCK_SIZE, &bw);
-      const uint32_t dur = time_us_32() - tm;
-      if (dur > 20000) {
-        SD_DBG_PRINTF("w: %d %ld %d %ld %ld", fr, b, bw, dur,
-                      time_us_32() - start);
+bool sdcard_needs_flush(void) {
+  if (!card_mounted || !writing_enabled) {
+    return false;
+  }
+  const uint32_t buffered = ring_buffer_get_num_bytes(&sdcard_rb);
+  if (gated) {
+    // open the file as soon as the gate opens, close it when it shuts
+    return (!segment_open && buffered) || !queue_is_empty(&segment_queue) ||
+           buffered >= SD_WRITE_SIZE;
+  }
+  return buffered >= SD_WRITE_SIZE;
+}
+
+static void flush_gated(void) {
+  if (!segment_open && ring_buffer_get_num_bytes(&sdcard_rb)) {
+    open_segment_file();
+  }
+  segment_event event;
+  const bool ending = queue_try_peek(&segment_queue, &event);
+  if (!segment_open) {
+    // the file could not be opened, drop the segment
+    if (ending) {
+      uint8_t discard[64];
+      for (uint32_t b = event.bytes; b; b -= std::min<uint32_t>(b, sizeof(discard))) {
+        ring_buffer_pop(&sdcard_rb, discard, std::min<uint32_t>(b, sizeof(discard)));
       }
-      if (FR_OK == fr) {
-        b_count += SD_BLOCK_SIZE;
-        b -= SD_BLOCK_SIZE;
-        fc++;
-      } else {
-        SD_DBG_PRINTF("write error: %d", fr);
+      queue_try_remove(&segment_queue, &event);
+    }
+    return;
+  }
+  write_buffered(ending, ending ? event.bytes - b_count : UINT32_MAX);
+  if (ending && b_count >= event.bytes) {
+    queue_try_remove(&segment_queue, &event);
+    close_segment(event);
+  }
+}
+
+// called from core 0 as the UI updates, for file names and the index
+void sdcard_set_channel(uint32_t frequency, uint8_t mode, int16_t signal_dBm) {
+  channel_frequency = frequency;
+  channel_mode = mode;
+  channel_signal_dBm = signal_dBm;
+  if (segment_open) {
+    segment_peak_dBm = std::max(segment_peak_dBm, signal_dBm);
+  }
+}
+
+void sdcard_flush(void) {
+  if (!card_mounted || !writing_enabled) {
+    return;
+  }
+
+  if (gated) {
+    flush_gated();
+    return;
+  }
+
+  write_buffered(false);
+  // time-shift segments carry a complete header from the start
+  if (!timeshift_enabled && bytes_since_sync >= SD_SYNC_BYTES) {
+    bytes_since_sync = 0;
+    update_header();
+    FRESULT fr = f_sync(&file);
+    if (fr != FR_OK) {
+      SD_DBG_PRINTF("sync error: %d", fr);
+    }
+  }
+}
+
+static uint32_t read_file(void* context, uint8_t buffer[], uint32_t bytes) {
+  unsigned int br = 0;
+  FRESULT fr = f_read((FIL*)context, buffer, bytes, &br);
+  if (fr != FR_OK) {
+    SD_DBG_PRINTF("read error: %d", fr);
+  }
+  return br;
+}
+
+static bool open_reader(void) {
+  if (f_lseek(&file, 0) != FR_OK || !reader.open(read_file, &file)) {
+    return false;
+  }
+  return reader.channels() == 2 &&
+         reader.sample_rate() == adc_sample_rate / cic_decimation_rate;
+}
+
+// plays recording number n in a loop, only IQ recordings can be played
+// back, for a committed time-shift only the first part. The recorded
+// frequency is taken from the file name.
+bool sdcard_start_playback(uint32_t n, uint32_t& frequency) {
+  sdcard_stop_timeshift();
+  if (!card_mounted || writing_enabled) {
+    return false;
+  }
+  sdcard_stop_playback();
+
+  char prefix[16];
+  snprintf(prefix, sizeof(prefix), "rec_%06ld_", n);
+  DIR dir;
+  FILINFO info;
+  bool found = false;
+  if (f_opendir(&dir, "") != FR_OK) {
+    return false;
+  }
+  while (f_readdir(&dir, &info) == FR_OK && info.fname[0]) {
+    // committed time-shift recordings play from their first part
+    if (strncmp(info.fname, prefix, strlen(prefix)) == 0 &&
+        (strstr(info.fname, "_IQ.") || strstr(info.fname, "_IQ_01."))) {
+      found = true;
+      break;
+    }
+  }
+  f_closedir(&dir);
+  if (!found) {
+    return false;
+  }
+
+  snprintf(filename, sizeof(filename), "%s", info.fname);
+  frequency = strtoul(filename + strlen(prefix), NULL, 10);
+  if (f_open(&file, filename, FA_READ) != FR_OK) {
+    return false;
+  }
+  if (!open_reader()) {
+    SD_DBG_PRINTF("can't play %s", filename);
+    f_close(&file);
+    return false;
+  }
+
+  discard_buffered();
+  playback_underruns = 0;
+  playback_enabled = true;
+  SD_DBG_PRINTF("Playing file: %s", filename);
+
+  // fill the read ahead before core 1 starts to consume it
+  while (sdcard_needs_fill()) {
+    sdcard_fill();
+  }
+  return playback_enabled;
+}
+
+void sdcard_stop_playback(void) {
+  if (!playback_enabled) {
+    return;
+  }
+  playback_enabled = false;
+  f_close(&file);
+  SD_DBG_PRINTF("playback underruns: %lu", playback_underruns);
+}
+
+bool sdcard_needs_fill(void) {
+  if (!playback_enabled) {
+    return false;
+  }
+  return BUF_SIZE - ring_buffer_get_num_bytes(&sdcard_rb) >= SD_WRITE_SIZE;
+}
+
+// called from core 0, reads ahead to keep the ring buffer full
+void sdcard_fill(void) {
+  if (!playback_enabled) {
+    return;
+  }
+  static int16_t block[2 * iq_frame_pairs];
+  uint32_t filled = 0;
+  bool rewound = false;
+  while (filled < SD_WRITE_SIZE &&
+         BUF_SIZE - ring_buffer_get_num_bytes(&sdcard_rb) >= sizeof(block)) {
+    const uint16_t n = reader.read(block, 2 * iq_frame_pairs);
+    if (n < 2 * iq_frame_pairs) {
+      // start again from the beginning, a partial last block is dropped.
+      // Give up if the recording doesn't hold a single whole block.
+      if (rewound || !open_reader()) {
+        sdcard_stop_playback();
+        return;
       }
+      rewound = true;
+      continue;
+    }
+    ring_buffer_push(&sdcard_rb, (const uint8_t*)block, sizeof(block));
+    filled += sizeof(block);
+    rewound = false;
+  }
+}
+
+// called from core 1, returns false if the read ahead has run dry
+bool sdcard_read(int16_t* iq, uint16_t n) {
+  if (!playback_enabled || ring_buffer_get_num_bytes(&sdcard_rb) < 2u * n) {
+    playback_underruns++;
+    return false;
+  }
+  ring_buffer_pop(&sdcard_rb, (uint8_t*)iq, 2 * n);
+  return true;
+}
+
+// survey state, core 0 only. Each band accumulates in its own slot, the live
+// spectrum shares slot 0 as the panorama takes over the tuning.
+struct s_survey_slot {
+  s_survey_range range;
+  uint16_t channels;
+  uint16_t sweeps;
+  uint16_t cpu_us;
+  uint32_t first_ms;
+  uint16_t peak[SD_SURVEY_MAX_CHANNELS];
+  uint32_t sum[SD_SURVEY_MAX_CHANNELS];
+};
+static bool survey_enabled = false;
+static FIL survey_file;
+static uint16_t survey_interval_s;
+static uint32_t survey_last_ms;
+static uint16_t survey_write_us;
+static s_survey_slot survey_slot[SD_SURVEY_BANDS];
+
+bool sdcard_start_survey(uint16_t interval_s) {
+  if (!card_mounted || survey_enabled) {
+    return false;
+  }
+  char name[24];
+  for (uint16_t n = 0; n < 1000; ++n) {
+    snprintf(name, sizeof(name), "survey_%03u.bin", n);
+    FRESULT fr = f_open(&survey_file, name, FA_CREATE_NEW | FA_WRITE);
+    if (FR_EXIST == fr) {
+      continue;
     }
-    if (fc >= 1024) {  // every ~1MB update and sync file
-      fc = 0;
-      update_wav_size();
-      fr = f_sync(&file);
-      if (fr != FR_OK) {
-        SD_DBG_PRINTF("sync error: %d", fr);
+    if (FR_OK != fr) {
+      SD_DBG_PRINTF("survey open failed: %d", fr);
+      return false;
+    }
+    uint8_t header[8];
+    memcpy(header, "PSRV", 4);
+    header[4] = SD_SURVEY_VERSION;
+    header[5] = 0;
+    header[6] = SD_SURVEY_RECORD_HEADER;
+    header[7] = 0;
+    unsigned int bw;
+    f_write(&survey_file, header, sizeof(header), &bw);
+    f_sync(&survey_file);
+    SD_DBG_PRINTF("Opening survey: %s", name);
+
+    survey_interval_s = std::max<uint16_t>(interval_s, 1);
+    survey_last_ms = time_us_32() / 1000;
+    survey_write_us = 0;
+    for (s_survey_slot &slot : survey_slot) {
+      slot.sweeps = 0;
+      slot.channels = 0;
+    }
+    survey_enabled = true;
+    return true;
+  }
+  return false;
+}
+
+static uint8_t survey_dB(uint32_t magnitude) {
+  return magnitude ? std::min(20.0f * log10f(magnitude), 255.0f) : 0;
+}
+
+static void put_le(uint8_t *out, uint32_t value, uint8_t bytes) {
+  for (uint8_t idx = 0; idx < bytes; ++idx) {
+    out[idx] = value >> (8 * idx);
+  }
+}
+
+static bool write_survey_record(s_survey_slot &slot, uint32_t now_ms) {
+  uint8_t record[SD_SURVEY_RECORD_HEADER + SD_SURVEY_MAX_CHANNELS];
+  uint8_t *level = record + SD_SURVEY_RECORD_HEADER;
+  uint8_t floor = 255;
+  for (uint16_t idx = 0; idx < slot.channels; ++idx) {
+    floor = std::min(floor, survey_dB(slot.sum[idx] / slot.sweeps));
+  }
+  for (uint16_t idx = 0; idx < slot.channels; ++idx) {
+    const uint8_t average = survey_dB(slot.sum[idx] / slot.sweeps);
+    const uint8_t peak = survey_dB(slot.peak[idx]);
+    const uint8_t above_floor = std::min((average - floor) / SD_SURVEY_STEP_DB, 15);
+    const uint8_t above_average = std::min(std::max(peak - average, 0) / SD_SURVEY_STEP_DB, 15);
+    level[idx] = (above_floor << 4) | above_average;
+  }
+  const uint16_t delta_s = std::min<uint32_t>((now_ms - survey_last_ms) / 1000, UINT16_MAX);
+  put_le(record + 0, delta_s, 2);
+  put_le(record + 2, slot.sweeps, 2);
+  record[4] = floor;
+  record[5] = slot.range.band;
+  put_le(record + 6, slot.cpu_us, 2);
+  put_le(record + 8, survey_write_us, 2);
+  put_le(record + 10, slot.channels, 2);
+  put_le(record + 12, (uint16_t)slot.range.fft_bin, 2);
+  put_le(record + 14, slot.range.tuned_Hz, 4);
+  put_le(record + 18, slot.range.start_Hz, 4);
+  put_le(record + 22, slot.range.stop_Hz, 4);
+
+  // delta times add up to the total elapsed, remainders carry over
+  survey_last_ms += 1000u * delta_s;
+  slot.sweeps = 0;
+
+  unsigned int bw;
+  const FRESULT fr = f_write(&survey_file, record, SD_SURVEY_RECORD_HEADER + slot.channels, &bw);
+  if (FR_OK != fr) {
+    SD_DBG_PRINTF("survey write error: %d", fr);
+  }
+  return FR_OK == fr;
+}
+
+// records are small and written once an interval, they are synced so an
+// unattended survey loses at most one interval if the power fails
+static void write_survey_records(uint32_t now_ms, bool all) {
+  const uint32_t start = time_us_32();
+  bool written = false;
+  for (s_survey_slot &slot : survey_slot) {
+    if (slot.sweeps && (all || now_ms - slot.first_ms >= SD_SURVEY_MIN_RECORD_MS)) {
+      written |= write_survey_record(slot, now_ms);
+    }
+    slot.sweeps = 0;
+  }
+  if (written) {
+    f_sync(&survey_file);
+    survey_write_us = std::min<uint32_t>(time_us_32() - start, UINT16_MAX);
+  }
+}
+
+void sdcard_stop_survey(void) {
+  if (!survey_enabled) {
+    return;
+  }
+  write_survey_records(time_us_32() / 1000, false);
+  f_close(&survey_file);
+  survey_enabled = false;
+}
+
+static bool same_range(const s_survey_range &a, const s_survey_range &b) {
+  return a.band == b.band && a.fft_bin == b.fft_bin && a.tuned_Hz == b.tuned_Hz &&
+         a.start_Hz == b.start_Hz && a.stop_Hz == b.stop_Hz;
+}
+
+// called from core 0 with the levels of each complete sweep or live capture
+void sdcard_survey_sweep(const s_survey_range &range, const uint16_t level[], uint16_t channels) {
+  if (!survey_enabled || channels > SD_SURVEY_MAX_CHANNELS) {
+    return;
+  }
+  const uint32_t start = time_us_32();
+  const uint32_t now_ms = start / 1000;
+  s_survey_slot &slot = survey_slot[range.band < SD_SURVEY_BANDS ? range.band : 0];
+
+  // a retune or a new band starts a new record, one left while tuning
+  // through is dropped
+  if (slot.sweeps && (slot.channels != channels || !same_range(slot.range, range))) {
+    if (now_ms - slot.first_ms >= SD_SURVEY_MIN_RECORD_MS) {
+      const uint32_t write_start = time_us_32();
+      if (write_survey_record(slot, now_ms)) {
+        f_sync(&survey_file);
+        survey_write_us = std::min<uint32_t>(time_us_32() - write_start, UINT16_MAX);
       }
     }
+    slot.sweeps = 0;
+  }
+  if (!slot.sweeps) {
+    slot.range = range;
+    slot.channels = channels;
+    slot.cpu_us = 0;
+    slot.first_ms = now_ms;
+    std::fill(slot.peak, slot.peak + channels, 0);
+    std::fill(slot.sum, slot.sum + channels, 0);
+  }
+
+  for (uint16_t idx = 0; idx < channels; ++idx) {
+    slot.peak[idx] = std::max(slot.peak[idx], level[idx]);
+    slot.sum[idx] += level[idx];
+  }
+  slot.sweeps = std::min<uint32_t>(slot.sweeps + 1u, UINT16_MAX);
+  slot.cpu_us = std::max<uint32_t>(slot.cpu_us, std::min<uint32_t>(time_us_32() - start, UINT16_MAX));
+
+  if (now_ms - survey_last_ms >= 1000u * survey_interval_s) {
+    write_survey_records(now_ms, true);
   }
 }
@@ -3,10 +3,38 @@
 #include <cstdint>
 
 bool sdcard_init(uint32_t c);
+uint32_t sdcard_get_counter(void);
 
-uint32_t sdcard_start_recording(uint32_t frequency, uint8_t mode);
+uint32_t sdcard_start_recording(uint32_t frequency, uint8_t mode, uint8_t record_mode, uint16_t squelch_hang_ms = 0);
 void sdcard_stop_recording(void);
 
-void sdcard_write(uint16_t const* const data, uint16_t n);
+bool sdcard_start_timeshift(uint8_t record_mode, uint8_t minutes);
+void sdcard_stop_timeshift(void);
+
+void sdcard_set_channel(uint32_t frequency, uint8_t mode, int16_t signal_dBm);
+
+void sdcard_write(uint16_t const* const data, uint16_t n, bool squelch_open = true);
 bool sdcard_needs_flush(void);
 void sdcard_flush(void);
+
+bool sdcard_start_playback(uint32_t n, uint32_t& frequency);
+void sdcard_stop_playback(void);
+bool sdcard_needs_fill(void);
+void sdcard_fill(void);
+bool sdcard_read(int16_t* iq, uint16_t n);
+
+// what a survey sweep covers: a panorama survey band, or the live spectrum
+// around the tuned frequency while listening
+#define SD_SURVEY_BANDS (4)
+#define SD_SURVEY_LIVE_BAND (255)
+struct s_survey_range {
+  uint8_t band;
+  int16_t fft_bin;    // the capture's fft_bin, 0 for a panorama band
+  uint32_t tuned_Hz;  // 0 for a panorama band, the sweep retunes
+  uint32_t start_Hz;
+  uint32_t stop_Hz;
+};
+
+bool sdcard_start_survey(uint16_t interval_s);
+void sdcard_stop_survey(void);
+void sdcard_survey_sweep(const s_survey_range &range, const uint16_t level[], uint16_t channels);
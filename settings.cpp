@@ -1,8 +1,11 @@
 #include "settings.h"
 #include "autosave_memory.h"
 #include "memory.h"
+#include "memory_index.h"
 #include <hardware/flash.h>
 #include "pico/multicore.h"
+#include "utils.h"
+#include <algorithm>
 #include <cstring>
 
 void apply_settings_to_rx(rx & receiver, rx_settings & rx_settings, s_settings & settings, bool suspend, bool settings_changed)
@@ -41,8 +44,9 @@ void apply_settings_to_rx(rx & receiver, rx_settings & rx_settings, s_settings &
   rx_settings.enable_external_nco = settings.global.enable_external_nco;
   rx_settings.treble = settings.global.treble;
   rx_settings.bass = settings.global.bass;
-  rx_settings.stream_raw_iq = settings.global.usb_stream;
-  rx_settings.sd_card_save = settings.global.sd_card_save;
+  rx_settings.usb_stream = settings.global.usb_stream;
+  //the time-shift ring captures whenever nothing else is being recorded
+  rx_settings.sd_card_save = settings.global.sd_card_save ? settings.global.sd_card_save : settings.global.sd_card_timeshift;
   rx_settings.tuning_option = settings.global.tuning_option;
   rx_settings.impulse_threshold = settings.global.impulse_threshold;
   rx_settings.nn_denoiser = settings.global.nn_denoiser;
@@ -58,37 +62,27 @@ s_memory_channel get_channel(uint16_t channel_number)
   return memory_channel;
 }
 
-void memory_store_channel(s_memory_channel memory_channel, uint16_t channel_number, s_settings & settings, rx & receiver, rx_settings & rx_settings)
-{
-  static_assert(sizeof(s_memory_channel) < memory_chan_size*4);
-
-  //work out which flash sector the channel sits in.
-  const uint32_t num_channels_per_sector = FLASH_SECTOR_SIZE/(sizeof(int)*memory_chan_size);
-  const uint32_t first_channel_in_sector = num_channels_per_sector * (channel_number/num_channels_per_sector);
-  const uint32_t channel_offset_in_sector = channel_number%num_channels_per_sector;
+//Memory channels are written a whole sector (64 channels) at a time. The
+//sector is staged in RAM, so a bulk upload can fill all 64 channels and
+//program the sector once, rather than once per channel.
+static uint32_t memory_staging[memory_channels_per_sector][memory_chan_size];
+static int16_t memory_staged_sector = -1;
+static int16_t memory_interrupted_sector = -1;
 
-  //copy sector to RAM
-  static uint32_t sector_copy[num_channels_per_sector][memory_chan_size];
-  for(uint16_t channel=0; channel<num_channels_per_sector; channel++)
-  {
-    for(uint16_t location=0; location<memory_chan_size; location++)
-    {
-      if(channel+first_channel_in_sector < num_chans)
-      {
-        sector_copy[channel][location] = radio_memory[channel+first_channel_in_sector][location];
-      }
-    }
-  }
-
-  //update the relevant part of the sector
-  memcpy(sector_copy[channel_offset_in_sector], &memory_channel, sizeof(s_memory_channel));
+static void memory_stage_sector(uint16_t sector)
+{
+  memcpy(memory_staging, radio_memory[sector*memory_channels_per_sector], sizeof(memory_staging));
+  memory_staged_sector = sector;
+}
 
+static void memory_program_staged(s_settings & settings, rx & receiver, rx_settings & rx_settings)
+{
   //write sector to flash
-  const uint32_t address = (uint32_t)&(radio_memory[first_channel_in_sector]);
+  const uint32_t address = (uint32_t)&(radio_memory[memory_staged_sector*memory_channels_per_sector]);
   const uint32_t flash_address = address - XIP_BASE;
 
   //!!! PICO is **very** fussy about flash erasing, there must be no code running in flash.  !!!
-  //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+  //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
   apply_settings_to_rx(receiver, rx_settings, settings, true, false); //suspend rx to disable all DMA transfers
   sleep_us(10000);                                    //wait for suspension to take effect
   multicore_lockout_start_blocking();                  //halt the second core
@@ -97,7 +91,7 @@ void memory_store_channel(s_memory_channel memory_channel, uint16_t channel_numb
   //safe to erase flash here
   //--------------------------------------------------------------------------------------------
   flash_range_erase(flash_address, FLASH_SECTOR_SIZE);
-  flash_range_program(flash_address, (const uint8_t*)&sector_copy, FLASH_SECTOR_SIZE);
+  flash_range_program(flash_address, (const uint8_t*)&memory_staging, FLASH_SECTOR_SIZE);
   //--------------------------------------------------------------------------------------------
 
   restore_interrupts (ints);                           //restore interrupts
@@ -106,114 +100,162 @@ void memory_store_channel(s_memory_channel memory_channel, uint16_t channel_numb
   //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
   //!!! Normal operation resumed
 
+  memory_staged_sector = -1;
+  memory_index_build();
 }
 
-
-void autosave_restore_settings(s_settings &settings)
+void memory_store_channel(s_memory_channel memory_channel, uint16_t channel_number, s_settings & settings, rx & receiver, rx_settings & rx_settings)
 {
+  static_assert(sizeof(s_memory_channel) < memory_chan_size*4);
+  static_assert(memory_channels_per_sector*memory_chan_size*sizeof(uint32_t) == FLASH_SECTOR_SIZE);
 
-  //make sure that the memory channels are large enough to store the struct
-  static_assert(sizeof(s_settings) < autosave_chan_size*4);
+  //copy sector to RAM, this discards any partly staged bulk upload, the
+  //host is told when it commits so that it can send the sector again
+  if(memory_staged_sector >= 0) memory_interrupted_sector = memory_staged_sector;
+  memory_stage_sector(channel_number/memory_channels_per_sector);
 
-  uint16_t latest_channel = 0xffff;
-  for(uint16_t i=0; i<512; i++)
-  {
-    if(autosave_memory[i][0] != 0xffffffff) //find stored settings
-    {
-      latest_channel = i;
-    }
-  }
+  //update the relevant part of the sector
+  memcpy(memory_staging[channel_number%memory_channels_per_sector], &memory_channel, sizeof(s_memory_channel));
+
+  memory_program_staged(settings, receiver, rx_settings);
+}
 
-  if(latest_channel == 0xffff)
+//channels of a sector that are not staged keep their current contents
+void memory_stage_channel(uint16_t channel_number, const uint32_t words[memory_chan_size])
+{
+  const uint16_t sector = channel_number/memory_channels_per_sector;
+  if(sector != memory_staged_sector) memory_stage_sector(sector);
+  memcpy(memory_staging[channel_number%memory_channels_per_sector], words, sizeof(memory_staging[0]));
+}
+
+//the sector is only programmed if it is the one staged and the CRC of the staged image matches
+e_memory_commit memory_commit_sector(uint16_t sector, uint16_t crc, s_settings & settings, rx & receiver, rx_settings & rx_settings)
+{
+  //part of this upload was lost, reported once so that a resend can succeed
+  if(sector == memory_interrupted_sector)
   {
-    settings = default_settings;
+    memory_interrupted_sector = -1;
+    if(sector == memory_staged_sector) memory_staged_sector = -1;
+    return MEMORY_COMMIT_INTERRUPTED;
   }
-  else
+  if(sector != memory_staged_sector) return MEMORY_COMMIT_FAILED;
+  if(crc16((const uint8_t*)memory_staging, sizeof(memory_staging)) != crc)
   {
-    memcpy(&settings, autosave_memory[latest_channel], sizeof(s_settings));
+    memory_staged_sector = -1;
+    return MEMORY_COMMIT_FAILED;
   }
-
+  memory_program_staged(settings, receiver, rx_settings);
+  return MEMORY_COMMIT_OK;
 }
 
-void autosave_store_settings(s_settings settings, rx & receiver, rx_settings & rx_settings)
+uint16_t memory_sector_crc(uint16_t sector)
 {
+  return crc16((const uint8_t*)radio_memory[sector*memory_channels_per_sector], FLASH_SECTOR_SIZE);
+}
 
-  //make sure that the memory channels are large enough to store the struct
-  static_assert(sizeof(s_settings) < autosave_chan_size*4);
-
-  //copy settings to an array
-  uint32_t data_to_save[autosave_chan_size] = {0xffffffff};
-  memcpy(data_to_save, &settings, sizeof(s_settings));
-
-  //The flash endurance may not be more than 100000 erase cycles.
-  //Cycle through 512 locations, only erasing the flash when they have all been used.
-  //This should give an endurance of 51,200,000 cycles.
 
-  //find the next unused channel, an unused channel will be 0xffffffff
-  uint16_t empty_channel = 0;
-  bool empty_channel_found = false;
-  for(uint16_t i=0; i<512; i++)
+//Autosave log
+//
+//The autosave region is used as a log of 128 byte records, 32 to a 4KB
+//sector. Each save programs one 256 byte flash page at the head of the log
+//(the other half of the page is programmed with 0xff, which leaves it
+//unchanged), so a save never rewrites a sector. When the head moves into a
+//sector, the sector after it is erased, one sector at a time instead of the
+//whole 64KB. The erase is left to autosave_erase_idle() so that it never
+//adds to a save. Each sector is still erased once per 512 saves.
+//
+//record: word 0 sequence number (0xffffffff when erased), word 1 key, size
+//and CRC-16 of the first 6 bytes and the data, then the data. A record with
+//a bad CRC, e.g. from a save cut short by power loss, is skipped.
+
+const uint16_t autosave_slots = 512;
+const uint16_t autosave_slots_per_sector = FLASH_SECTOR_SIZE/(sizeof(uint32_t)*autosave_chan_size);
+const uint16_t autosave_sectors = autosave_slots/autosave_slots_per_sector;
+const uint8_t  autosave_header_words = 2;
+const uint8_t  autosave_key_settings = 1;
+
+//head of the log, found once at boot
+static uint16_t autosave_head = 0;
+static uint32_t autosave_sequence = 0;
+static uint32_t autosave_max_suspend_us = 0;
+static bool autosave_erase_pending = true;
+static uint32_t autosave_store_time = 0;
+const uint32_t autosave_erase_delay_us = 2000000u;
+
+static bool autosave_slot_erased(uint16_t slot)
+{
+  for(uint8_t word=0; word<autosave_chan_size; word++)
   {
-    volatile uint32_t * check_address = (uint32_t*)&autosave_memory[i][0];
-    if(*check_address == 0xffffffff)
-    {
-      empty_channel = i;
-      empty_channel_found = true;
-      break;
-    }
+    if(autosave_memory[slot][word] != 0xffffffff) return false;
   }
+  return true;
+}
 
-  //if there are no free channels, erase all the pages
-  if(!empty_channel_found)
+static bool autosave_sector_erased(uint16_t first_slot)
+{
+  for(uint16_t slot=first_slot; slot<first_slot+autosave_slots_per_sector; slot++)
   {
-    const uint32_t address = (uint32_t)&(autosave_memory[0]);
-    const uint32_t flash_address = address - XIP_BASE;
-    //!!! PICO is **very** fussy about flash erasing, there must be no code running in flash.  !!!
-    //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-    apply_settings_to_rx(receiver, rx_settings, settings, true, false); //suspend rx to disable all DMA transfers
-    sleep_us(10000);                                    //wait for suspension to take effect
-    multicore_lockout_start_blocking();                  //halt the second core
-    const uint32_t ints = save_and_disable_interrupts(); //disable all interrupts
-
-    //safe to erase flash here
-    //--------------------------------------------------------------------------------------------
-    flash_range_erase(flash_address, sizeof(int)*autosave_chan_size*512);
-    //--------------------------------------------------------------------------------------------
-
-    restore_interrupts (ints);                           //restore interrupts
-    multicore_lockout_end_blocking();                    //restart the second core
-    apply_settings_to_rx(receiver, rx_settings, settings, false, false); //resume rx operation
-    //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-    //!!! Normal operation resumed
+    if(!autosave_slot_erased(slot)) return false;
   }
+  return true;
+}
 
-  //work out which flash sector the channel sits in.
-  const uint32_t num_channels_per_sector = FLASH_SECTOR_SIZE/(sizeof(int)*autosave_chan_size);
-  const uint32_t first_channel_in_sector = num_channels_per_sector * (empty_channel/num_channels_per_sector);
-  const uint32_t channel_offset_in_sector = empty_channel%num_channels_per_sector;
+static uint16_t autosave_record_crc(const uint32_t record[])
+{
+  const uint8_t size = record[1] >> 8;
+  const uint16_t crc = crc16((const uint8_t*)record, 6);
+  return crc16((const uint8_t*)&record[autosave_header_words], size, crc);
+}
+
+static bool autosave_slot_valid(uint16_t slot)
+{
+  const uint32_t *record = autosave_memory[slot];
+  if(record[0] == 0xffffffff) return false;
+  if(((record[1] >> 8) & 0xff) > sizeof(uint32_t)*(autosave_chan_size-autosave_header_words)) return false;
+  return (record[1] >> 16) == autosave_record_crc(record);
+}
 
-  //copy sector to RAM
-  static uint32_t sector_copy[num_channels_per_sector][autosave_chan_size];
-  for(uint16_t channel=0; channel<num_channels_per_sector; channel++)
+//the newest sector is found from its first record, then the end of the log
+//within it, so at most 48 records are read
+static bool autosave_find_head()
+{
+  bool found = false;
+  uint16_t newest_sector = 0;
+  for(uint16_t sector=0; sector<autosave_sectors; sector++)
   {
-    for(uint16_t location=0; location<autosave_chan_size; location++)
+    const uint16_t slot = sector*autosave_slots_per_sector;
+    if(autosave_slot_valid(slot) && (!found || autosave_memory[slot][0] > autosave_sequence))
     {
-      if(channel+first_channel_in_sector < num_chans)
-      {
-        sector_copy[channel][location] = autosave_memory[channel+first_channel_in_sector][location];
-      }
+      autosave_sequence = autosave_memory[slot][0];
+      newest_sector = sector;
+      found = true;
     }
   }
+  if(!found) return false;
 
-  //modify the selected channel
-  for(uint8_t i=0; i<autosave_chan_size; i++)
+  const uint16_t first_slot = newest_sector*autosave_slots_per_sector;
+  autosave_head = first_slot;
+  for(uint16_t slot=first_slot; slot<first_slot+autosave_slots_per_sector; slot++)
   {
-    sector_copy[channel_offset_in_sector][i] = data_to_save[i];
+    if(autosave_memory[slot][0] == 0xffffffff) break;
+    if(autosave_slot_valid(slot) && autosave_memory[slot][0] > autosave_sequence)
+    {
+      autosave_sequence = autosave_memory[slot][0];
+    }
+    autosave_head = slot + 1;
   }
+  autosave_head %= autosave_slots;
+  autosave_sequence++;
+  return true;
+}
 
-  //write sector to flash
-  const uint32_t address = (uint32_t)&(autosave_memory[first_channel_in_sector]);
+//erase the sector holding slot, or program the page holding it
+static void autosave_flash(uint16_t slot, const uint32_t page[], s_settings & settings, rx & receiver, rx_settings & rx_settings)
+{
+  const uint32_t first_slot = page ? slot & ~1u : slot - slot%autosave_slots_per_sector;
+  const uint32_t address = (uint32_t)&(autosave_memory[first_slot]);
   const uint32_t flash_address = address - XIP_BASE;
+  const uint32_t start = time_us_32();
 
   //!!! PICO is **very** fussy about flash erasing, there must be no code running in flash.  !!!
   //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
@@ -224,13 +266,129 @@ void autosave_store_settings(s_settings settings, rx & receiver, rx_settings & r
 
   //safe to erase flash here
   //--------------------------------------------------------------------------------------------
-  flash_range_program(flash_address, (const uint8_t*)&sector_copy, FLASH_SECTOR_SIZE);
+  if(page)
+  {
+    flash_range_program(flash_address, (const uint8_t*)page, FLASH_PAGE_SIZE);
+  }
+  else
+  {
+    flash_range_erase(flash_address, FLASH_SECTOR_SIZE);
+  }
   //--------------------------------------------------------------------------------------------
 
   restore_interrupts (ints);                           //restore interrupts
   multicore_lockout_end_blocking();                    //restart the second core
-  apply_settings_to_rx(receiver, rx_settings, settings, false, false);  //resume rx operation
+  apply_settings_to_rx(receiver, rx_settings, settings, false, false); //resume rx operation
   //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
   //!!! Normal operation resumed
 
+  autosave_max_suspend_us = std::max(autosave_max_suspend_us, time_us_32() - start);
+}
+
+uint32_t autosave_worst_suspend_us()
+{
+  return autosave_max_suspend_us;
+}
+
+void autosave_restore_settings(s_settings &settings)
+{
+
+  //make sure that the records are large enough to store the struct
+  static_assert(sizeof(s_settings) <= sizeof(uint32_t)*(autosave_chan_size-autosave_header_words));
+
+  settings = default_settings;
+  if(autosave_find_head())
+  {
+    //the latest settings are normally the record before the head
+    for(uint16_t age=1; age<=autosave_slots; age++)
+    {
+      const uint16_t slot = (autosave_head + autosave_slots - age)%autosave_slots;
+      if(autosave_slot_valid(slot) && (autosave_memory[slot][1] & 0xff) == autosave_key_settings)
+      {
+        const uint8_t size = autosave_memory[slot][1] >> 8;
+        memcpy(&settings, &autosave_memory[slot][autosave_header_words], std::min<uint32_t>(size, sizeof(s_settings)));
+        return;
+      }
+    }
+    return;
+  }
+
+  //settings saved by older firmware are the last used slot, stored as is
+  uint16_t latest_channel = 0xffff;
+  for(uint16_t i=0; i<autosave_slots; i++)
+  {
+    if(autosave_memory[i][0] != 0xffffffff) //find stored settings
+    {
+      latest_channel = i;
+    }
+  }
+
+  if(latest_channel != 0xffff)
+  {
+    memcpy(&settings, autosave_memory[latest_channel], sizeof(s_settings));
+    //the log starts on a sector boundary so the newest sector can be found
+    autosave_head = (latest_channel/autosave_slots_per_sector + 1)*autosave_slots_per_sector%autosave_slots;
+  }
+}
+
+void autosave_store_settings(s_settings settings, rx & receiver, rx_settings & rx_settings)
+{
+
+  //make sure that the records are large enough to store the struct
+  static_assert(sizeof(s_settings) <= sizeof(uint32_t)*(autosave_chan_size-autosave_header_words));
+  static_assert(FLASH_PAGE_SIZE == 2*sizeof(uint32_t)*autosave_chan_size);
+
+  //skip anything left by an interrupted save, a used sector is erased first
+  //(only if autosave_erase_idle() hasn't had a chance to erase it)
+  while(!autosave_slot_erased(autosave_head))
+  {
+    if(autosave_head%autosave_slots_per_sector == 0)
+    {
+      autosave_flash(autosave_head, NULL, settings, receiver, rx_settings);
+      break;
+    }
+    autosave_head = (autosave_head + 1)%autosave_slots;
+  }
+
+  //fill the half of the page that holds the record
+  static uint32_t page[2*autosave_chan_size];
+  memset(page, 0xff, sizeof(page));
+  uint32_t *record = &page[(autosave_head%2)*autosave_chan_size];
+  record[0] = autosave_sequence;
+  record[1] = autosave_key_settings | (sizeof(s_settings) << 8);
+  memcpy(&record[autosave_header_words], &settings, sizeof(s_settings));
+  record[1] |= (uint32_t)autosave_record_crc(record) << 16;
+  autosave_flash(autosave_head, page, settings, receiver, rx_settings);
+
+  autosave_sequence++;
+  autosave_head = (autosave_head + 1)%autosave_slots;
+
+  //once the head enters a sector, the next one is erased when the UI is idle
+  if(autosave_head%autosave_slots_per_sector == 0) autosave_erase_pending = true;
+  autosave_store_time = time_us_32();
+
+}
+
+//erase the sector that the head will need next, called from the UI when
+//nothing has been saved for a while so the erase is a separate suspension
+void autosave_erase_idle(s_settings settings, rx & receiver, rx_settings & rx_settings)
+{
+  if(!autosave_erase_pending) return;
+  if(time_us_32() - autosave_store_time < autosave_erase_delay_us) return;
+
+  //at boot the head can sit at the start of a sector that isn't erased yet,
+  //erase that first and leave the next sector for a later call
+  const uint16_t first_slot = autosave_head - autosave_head%autosave_slots_per_sector;
+  if(autosave_head == first_slot && !autosave_sector_erased(first_slot))
+  {
+    autosave_flash(first_slot, NULL, settings, receiver, rx_settings);
+    return;
+  }
+
+  autosave_erase_pending = false;
+  const uint16_t next_sector = (first_slot + autosave_slots_per_sector)%autosave_slots;
+  if(!autosave_sector_erased(next_sector))
+  {
+    autosave_flash(next_sector, NULL, settings, receiver, rx_settings);
+  }
 }
@@ -9,6 +9,8 @@ const char steps[13][8]  = { "10Hz", "50Hz", "100Hz", "500Hz", "1kHz", "5kHz", "
 const uint8_t  autosave_chan_size = 32;
 const uint8_t  memory_chan_size = 16;
 const uint16_t num_chans = 512;
+const uint16_t memory_channels_per_sector = 4096/(4*memory_chan_size);
+const uint16_t memory_sectors = num_chans/memory_channels_per_sector;
 
 enum e_mode
 {
@@ -20,6 +22,13 @@ enum e_mode
   MODE_CW = 5,
 };
 
+enum e_memory_commit
+{
+  MEMORY_COMMIT_OK = 0,
+  MEMORY_COMMIT_FAILED = 1,      //sector not staged or CRC mismatch
+  MEMORY_COMMIT_INTERRUPTED = 2, //a single channel store replaced the staged sector
+};
+
 //*** NOTE TO SELF ***
 //*****************************************************************************
 //remember to change channel_to_words.py
@@ -81,8 +90,8 @@ struct s_global_settings
   uint8_t impulse_threshold;
   uint32_t sd_card_counter;
   bool    nn_denoiser;
-  bool    usb_stream;
-  bool    sd_card_save;
+  uint8_t usb_stream;
+  uint8_t sd_card_save;
   bool    enable_auto_notch;
   bool    iq_correction;
   bool    enable_noise_reduction;
@@ -95,6 +104,16 @@ struct s_global_settings
   bool    tx_modulation;
   bool    enable_external_nco;
   bool    spectrum_hold;
+  uint8_t sd_card_timeshift;
+  uint8_t sd_card_timeshift_minutes;
+  uint8_t sd_card_squelch;
+  uint8_t panorama_start_MHz;
+  uint8_t panorama_stop_MHz;
+  uint8_t panorama_settle_ms;
+  uint8_t panorama_dwell_ms;
+  uint8_t sd_card_survey;
+  uint8_t survey_band_start_MHz[4];
+  uint8_t survey_band_stop_MHz[4];
 };
 
 struct s_settings
@@ -170,6 +189,16 @@ const s_settings default_settings = {
   0,  //tx_modulation
   0,  //enable_external_nco
   0,  //spectrum_hold
+  0,  //sd_card_timeshift
+  2,  //sd_card_timeshift_minutes
+  0,  //sd_card_squelch
+  0,  //panorama_start_MHz
+  30, //panorama_stop_MHz
+  10, //panorama_settle_ms
+  40, //panorama_dwell_ms
+  0,  //sd_card_survey = off
+  {0, 0, 0, 0}, //survey_band_start_MHz
+  {0, 0, 0, 0}, //survey_band_stop_MHz = unused, the survey sweeps the panorama range
 }};
 
 
@@ -183,7 +212,12 @@ struct s_memory_channel
 void apply_settings_to_rx(rx & receiver, rx_settings & rx_settings, s_settings & settings, bool suspend, bool settings_changed);
 void autosave_restore_settings(s_settings &settings);
 void autosave_store_settings(s_settings settings, rx & receiver, rx_settings & rx_settings);
+void autosave_erase_idle(s_settings settings, rx & receiver, rx_settings & rx_settings);
+uint32_t autosave_worst_suspend_us();
 s_memory_channel get_channel(uint16_t channel_number);
 void memory_store_channel(s_memory_channel memory_channel, uint16_t channel_number, s_settings & settings, rx & receiver, rx_settings & rx_settings);
+void memory_stage_channel(uint16_t channel_number, const uint32_t words[memory_chan_size]);
+e_memory_commit memory_commit_sector(uint16_t sector, uint16_t crc, s_settings & settings, rx & receiver, rx_settings & rx_settings);
+uint16_t memory_sector_crc(uint16_t sector);
 
 #endif
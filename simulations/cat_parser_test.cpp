@@ -0,0 +1,137 @@
+#include "../cat_parser.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+
+struct s_cat_context
+{
+  uint32_t dispatched;
+  uint32_t checksum;
+};
+
+static void handler(s_cat_context &context, const s_cat_command &command, const char *args)
+{
+  context.dispatched++;
+  context.checksum += command.name[0] + args[0];
+}
+
+//same names as cat.cpp
+static const s_cat_command commands[] = {
+  {"AC", handler, NULL}, {"AG", handler, NULL}, {"AI", handler, NULL}, {"BC", handler, NULL},
+  {"EX", handler, NULL}, {"FA", handler, NULL}, {"FB", handler, NULL}, {"FL", handler, NULL},
+  {"FR", handler, NULL}, {"FT", handler, NULL}, {"FW", handler, NULL}, {"GT", handler, NULL},
+  {"ID", handler, NULL}, {"IF", handler, NULL}, {"IS", handler, NULL}, {"KS", handler, NULL},
+  {"LK", handler, NULL}, {"MD", handler, NULL}, {"MG", handler, NULL}, {"ML", handler, NULL},
+  {"NB", handler, NULL}, {"NR", handler, NULL}, {"PA", handler, NULL}, {"PC", handler, NULL},
+  {"PL", handler, NULL}, {"PR", handler, NULL}, {"PS", handler, NULL}, {"RA", handler, NULL},
+  {"RC", handler, NULL}, {"RG", handler, NULL}, {"RL", handler, NULL}, {"RM", handler, NULL},
+  {"RS", handler, NULL}, {"RT", handler, NULL}, {"SD", handler, NULL}, {"SH", handler, NULL},
+  {"SL", handler, NULL}, {"SM", handler, NULL}, {"SQ", handler, NULL}, {"TX", handler, NULL},
+  {"VD", handler, NULL}, {"VG", handler, NULL}, {"VX", handler, NULL}, {"XT", handler, NULL},
+  {"ZDN", handler, NULL}, {"ZMC", handler, NULL}, {"ZMF", handler, NULL}, {"ZML", handler, NULL},
+  {"ZMR", handler, NULL}, {"ZMW", handler, NULL}, {"ZSP", handler, NULL}, {"ZSR", handler, NULL},
+  {"ZUP", handler, NULL},
+};
+static const uint16_t num_commands = sizeof(commands)/sizeof(commands[0]);
+
+//reference: linear search over the whole terminated command
+static const s_cat_command *reference_lookup(const std::string &command)
+{
+  if(command.size() > cat_max_command_length) return NULL;
+  for(uint16_t idx = 0; idx < num_commands; ++idx)
+  {
+    if(strncmp(command.c_str(), commands[idx].name, strlen(commands[idx].name)) == 0) return &commands[idx];
+  }
+  return NULL;
+}
+
+static bool fuzz(uint32_t iterations)
+{
+  std::mt19937 rng(1234);
+  const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789;;; \r\n\xff";
+  cat_parser parser(commands, num_commands);
+
+  for(uint32_t iteration = 0; iteration < iterations; ++iteration)
+  {
+    //mix of valid names, random bytes and over-length commands
+    std::string command;
+    const uint32_t kind = rng() % 4;
+    if(kind == 0)
+    {
+      command = commands[rng() % num_commands].name;
+    }
+    const uint32_t length = kind == 3 ? rng() % (2*cat_max_command_length) : rng() % 12;
+    for(uint32_t idx = 0; idx < length; ++idx)
+    {
+      const char c = kind == 1 ? (char)(rng() & 0xff) : alphabet[rng() % (sizeof(alphabet) - 1)];
+      if(c != ';') command += c;
+    }
+    while(!command.empty() && (command[0] == '\r' || command[0] == '\n' || command[0] == ' ')) command.erase(0, 1);
+    command += ';';
+
+    const s_cat_command *expected = reference_lookup(command);
+    uint32_t completed = 0;
+    const s_cat_command *got = NULL;
+    for(char c : command)
+    {
+      if(parser.feed(c))
+      {
+        completed++;
+        got = parser.command();
+      }
+    }
+    if(completed != 1 || got != expected)
+    {
+      printf("fuzz failure at iteration %u, command length %zu\n", iteration, command.size());
+      return false;
+    }
+    if(got && strcmp(parser.args(), command.c_str() + strlen(got->name)) != 0)
+    {
+      printf("argument mismatch at iteration %u\n", iteration);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void benchmark()
+{
+  const char *traffic = "FA;IF;SM0;MD;FA00007074000;MD2;FR;FT;AI;ID;PS;TX;ZDN001;XT;RT;";
+  const uint32_t repeats = 200000;
+  const uint32_t commands_per_repeat = 15;
+  const size_t length = strlen(traffic);
+
+  cat_parser parser(commands, num_commands);
+  s_cat_context context = {0, 0};
+  const auto start = std::chrono::steady_clock::now();
+  for(uint32_t repeat = 0; repeat < repeats; ++repeat)
+  {
+    for(size_t idx = 0; idx < length; ++idx)
+    {
+      if(parser.feed(traffic[idx]) && parser.command())
+      {
+        parser.command()->handler(context, *parser.command(), parser.args());
+      }
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("dispatched %u commands (checksum %u)\n", context.dispatched, context.checksum);
+  printf("%.2f million commands per second, %.1f ns per byte\n",
+    repeats * commands_per_repeat / seconds / 1e6, seconds * 1e9 / (repeats * length));
+}
+
+int main()
+{
+  if(!cat_parser::table_is_sorted(commands, num_commands))
+  {
+    printf("command table is not sorted\n");
+    return 1;
+  }
+  if(!fuzz(1000000)) return 1;
+  printf("fuzz passed\n");
+  benchmark();
+  return 0;
+}
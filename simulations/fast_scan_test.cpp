@@ -0,0 +1,78 @@
+#include "../fast_scan.h"
+#include "../cic_corrections.h"
+#include "../rx_definitions.h"
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+//synthetic capture, noise plus carriers at the given offsets from the tuned
+//frequency, with the cic droop that cic_correct removes
+static void make_capture(int16_t capture[256], const int32_t carriers_Hz[], uint8_t num_carriers, int16_t amplitude, int16_t fft_offset = 0)
+{
+  for(uint16_t i = 0; i < 256; ++i) capture[i] = 40 + rand() % 40;
+  for(uint8_t c = 0; c < num_carriers; ++c)
+  {
+    const int16_t bin = lroundf(carriers_Hz[c] / (fast_scan_bin_width_mHz / 1000.0f));
+    if(bin < -128 || bin > 127) continue;
+    capture[(uint8_t)bin] = amplitude;
+  }
+  for(uint16_t i = 0; i < 256; ++i)
+  {
+    const int16_t bin = i > 127 ? i - 256 : i;
+    capture[i] = ((int32_t)capture[i] << 8) / cic_correction[abs(bin + fft_offset)];
+    if(capture[i] == 0) capture[i] = 1;
+  }
+}
+
+int main()
+{
+  int16_t capture[256];
+
+  //the first occupied channel in either direction is found
+  const uint32_t steps_Hz[] = {100, 500, 1000, 5000, 6250, 9000, 10000};
+  for(uint32_t step_Hz : steps_Hz)
+  {
+    const uint16_t span = fast_scan_span(step_Hz);
+    for(uint16_t target = 1; target <= span; ++target)
+    {
+      for(int8_t direction = -1; direction <= 1; direction += 2)
+      {
+        if(target * step_Hz > 7500u) continue;
+        //the bins either side of the LO at DC are masked
+        if(target * step_Hz * 1000u < 2u * fast_scan_bin_width_mHz) continue;
+        const int32_t carriers[] = {direction * (int32_t)(target * step_Hz), -direction * 3000, direction * 7400};
+        make_capture(capture, carriers, 3, 2000);
+        const uint16_t found = fast_scan_find(capture, 0, step_Hz, direction, span);
+        //steps smaller than a bin resolve to the first channel in the target's bin
+        const float bin_width_Hz = fast_scan_bin_width_mHz / 1000.0f;
+        assert(found == target || lroundf(found * step_Hz / bin_width_Hz) == lroundf(target * step_Hz / bin_width_Hz));
+      }
+    }
+
+    //nothing above the noise, the whole span is skipped
+    make_capture(capture, NULL, 0, 0);
+    assert(fast_scan_find(capture, 0, step_Hz, 1, span) == 0);
+  }
+
+  //a carrier below the 10dB margin is ignored
+  const int32_t weak[] = {2000};
+  make_capture(capture, weak, 1, 150);
+  assert(fast_scan_find(capture, 0, 1000, 1, fast_scan_span(1000)) == 0);
+
+  //the LO/DC spur at -fft_offset is not a signal, 38 bins is the default IF
+  const int16_t fft_offset = 38;
+  const int32_t spur[] = {-fft_offset * (int32_t)fast_scan_bin_width_mHz / 1000};
+  make_capture(capture, spur, 1, 2000, fft_offset);
+  assert(fast_scan_find(capture, fft_offset, 1000, -1, fast_scan_span(1000)) == 0);
+
+  //channels per second, the existing scanner steps one channel per hop
+  printf("step      channels/hop  channels/s at speed 1-4 (was 1-4)\n");
+  for(uint32_t step_Hz : steps_Hz)
+  {
+    const uint16_t span = fast_scan_span(step_Hz);
+    printf("%-9lu %-13u %u, %u, %u, %u\n", (unsigned long)step_Hz, span, span, 2 * span, 3 * span, 4 * span);
+  }
+  printf("fast scan test passed\n");
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include "../nco_plan.h"
+#include "../clocks.h"
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+//the exhaustive double precision search that nco_plan_frequency replaces,
+//returns the error of the best plan in Hz at the nco frequency
+static double reference_error(double tuned_frequency, uint8_t if_frequency_hz_over_100, uint8_t if_mode, uint8_t &best_pll)
+{
+  const double up = tuned_frequency + if_frequency_hz_over_100*100;
+  const double down = tuned_frequency - if_frequency_hz_over_100*100;
+  double best_error = 1e9;
+  for(uint8_t idx = 0; idx < num_possible_frequencies; idx++)
+  {
+    const double sys = possible_frequencies[idx].frequency;
+    for(uint8_t side = 0; side < 2; side++)
+    {
+      if(side == 0 && if_mode == 0) continue;
+      if(side == 1 && if_mode == 1) continue;
+      const double target = 4.0 * (side == 0 ? up : down);
+      const double divider = round(256.0*sys/target)/256.0;
+      const double error = fabs(sys/divider - target)/4.0;
+      if(error < best_error)
+      {
+        best_error = error;
+        best_pll = idx;
+      }
+    }
+  }
+  return best_error;
+}
+
+static double plan_error(const s_nco_plan &plan, double tuned_frequency, uint8_t if_frequency_hz_over_100, uint8_t if_mode)
+{
+  const double up = fabs(plan.frequency_Hz - (tuned_frequency + if_frequency_hz_over_100*100));
+  const double down = fabs(plan.frequency_Hz - (tuned_frequency - if_frequency_hz_over_100*100));
+  return if_mode == 1 ? up : if_mode == 0 ? down : std::min(up, down);
+}
+
+int main()
+{
+  //without a system clock in use the plan is as good as the exhaustive search
+  for(uint32_t n = 0; n < 20000; ++n)
+  {
+    const double frequency = 100e3 + (rand() % 30000000);
+    const uint8_t if_mode = rand() % 3;
+    const uint8_t if_frequency = (n & 1) ? rand() % 100 : 0;
+    uint8_t reference_pll;
+    const double reference = reference_error(frequency, if_frequency, if_mode, reference_pll);
+    const s_nco_plan plan = nco_plan_frequency(frequency, if_frequency, if_mode, -1);
+    const double error = plan_error(plan, frequency, if_frequency, if_mode);
+    if(error > reference + 0.1)
+    {
+      printf("%.0f Hz if_mode %u: error %.2f Hz, exhaustive search %.2f Hz\n", frequency, if_mode, error, reference);
+      return 1;
+    }
+  }
+
+  //sweeps, count system clock changes and check the hold error, with no IF,
+  //the default 4.5kHz IF and a small 1kHz IF
+  struct {double start, stop, step;} sweeps[] = {
+    {530e3, 1700e3, 9e3}, {3.5e6, 3.8e6, 1e3}, {7.0e6, 7.3e6, 1e3}, {14.0e6, 14.35e6, 1e3},
+    {21.0e6, 21.45e6, 1e3}, {28.0e6, 29.7e6, 5e3}, {100e3, 30e6, 10e3}};
+  const uint8_t if_frequencies[] = {0, 45, 10};
+  for(const uint8_t if_frequency : if_frequencies)
+  for(auto &sweep : sweeps)
+  {
+    const double if_Hz = if_frequency * 100.0;
+    const double hold_error = nco_hold_error(if_frequency);
+    //the LO may move at most a quarter of the IF (and 2kHz) from where it should be
+    const double if_band = if_Hz ? std::min(2000.0, if_Hz / 4) : 2000.0;
+    uint32_t steps = 0, changes = 0, reference_changes = 0;
+    int16_t active_pll = -1;
+    uint8_t last_reference_pll = 255;
+    double worst_error = 0, worst_reference = 0;
+    double plan_us = 0;
+    for(double frequency = sweep.start; frequency < sweep.stop; frequency += sweep.step)
+    {
+      uint8_t reference_pll;
+      const double reference = reference_error(frequency, if_frequency, 2, reference_pll);
+      if(reference_pll != last_reference_pll) reference_changes++;
+      last_reference_pll = reference_pll;
+
+      const auto start = std::chrono::steady_clock::now();
+      const s_nco_plan plan = nco_plan_frequency(frequency, if_frequency, 2, active_pll);
+      plan_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+      if(plan.pll != active_pll) changes++;
+      active_pll = plan.pll;
+
+      const double error = plan_error(plan, frequency, if_frequency, 2);
+      assert(error <= std::max(hold_error, reference) + 0.1);
+
+      //keeping the system clock must not move the LO much closer to the
+      //signal than the IF, or push the signal onto DC, unless no system
+      //clock can do better
+      const double offset = fabs(plan.frequency_Hz - frequency);
+      if(fabs(offset - if_Hz) > std::max(if_band, reference) + 0.1)
+      {
+        printf("%.0f Hz IF %.0f Hz: LO %.1f Hz from the signal\n", frequency, if_Hz, offset);
+        return 1;
+      }
+      worst_error = std::max(worst_error, error);
+      worst_reference = std::max(worst_reference, reference);
+      steps++;
+    }
+    printf("IF %4.0f Hz %6.3f-%6.3f MHz step %5.0f Hz: %5u retunes, pll changes %5u (exhaustive %5u), worst error %4.0f Hz (exhaustive %4.0f Hz), %.2f us per plan on host\n",
+           if_Hz, sweep.start/1e6, sweep.stop/1e6, sweep.step, steps, changes, reference_changes,
+           worst_error, worst_reference, plan_us/steps);
+  }
+  return 0;
+}
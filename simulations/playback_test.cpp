@@ -0,0 +1,39 @@
+#include "../codecs/recording_reader.h"
+#include <cstdio>
+
+static uint32_t read_file(void *context, uint8_t buffer[], uint32_t bytes)
+{
+  return fread(buffer, 1, bytes, (FILE*)context);
+}
+
+//usage: playback_test recording.wav|recording.riq
+//prints one sample (mono) or IQ pair (stereo) per line, in the format read
+//by the other harnesses, e.g. playback_test rec.riq | noise_reduction_test
+int main(int argc, char *argv[])
+{
+  if(argc != 2) return 1;
+  FILE *input = fopen(argv[1], "rb");
+  if(!input) return 1;
+
+  recording_reader reader;
+  if(!reader.open(read_file, input))
+  {
+    fprintf(stderr, "unsupported recording\n");
+    return 1;
+  }
+  fprintf(stderr, "%u channels, %u Hz\n", reader.channels(), reader.sample_rate());
+
+  int16_t samples[256];
+  const uint16_t channels = reader.channels();
+  uint16_t n;
+  while((n = reader.read(samples, 256 - 256 % channels)))
+  {
+    for(uint16_t idx = 0; idx + channels <= n; idx += channels)
+    {
+      if(channels == 2) printf("%i %i\n", samples[idx], samples[idx + 1]);
+      else printf("%i\n", samples[idx]);
+    }
+  }
+  fclose(input);
+  return 0;
+}
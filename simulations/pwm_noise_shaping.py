@@ -0,0 +1,67 @@
+import numpy as np
+import matplotlib.pyplot as plt
+
+# Bit accurate model of interpolate_block in pwm_audio_sink.cpp. Measures the
+# SNR of the PWM duty cycle sequence in the audio band with and without the
+# second order noise shaper.
+
+AUDIO_FS = 15000
+INTERPOLATION_RATE = 16
+PWM_FS = AUDIO_FS * INTERPOLATION_RATE
+PWM_MAX = 150000000 // PWM_FS - 1  # lowest system clock
+LEVEL_FRAC_BITS = 8
+FRAC_BITS = LEVEL_FRAC_BITS + 4
+
+
+def interpolate(samples, noise_shaping):
+    last_level = 0
+    integrator = 0
+    error1 = 0
+    error2 = 0
+    out = []
+    for sample in samples:
+        level = ((int(sample) + 32768) * PWM_MAX) >> (16 - LEVEL_FRAC_BITS)
+        comb = level - last_level
+        last_level = level
+        for _ in range(INTERPOLATION_RATE):
+            integrator += comb
+            shaped = integrator
+            if noise_shaping:
+                shaped -= 2 * error1 - error2
+            quantised = (shaped + (1 << (FRAC_BITS - 1))) >> FRAC_BITS
+            quantised = min(max(quantised, 0), PWM_MAX)
+            error = (quantised << FRAC_BITS) - shaped
+            error = min(max(error, -(1 << FRAC_BITS)), 1 << FRAC_BITS)
+            error2 = error1
+            error1 = error
+            out.append(quantised)
+    return np.array(out, dtype=float)
+
+
+def audio_band_snr(pwm, tone_Hz):
+    x = (pwm - np.mean(pwm)) * np.blackman(len(pwm))
+    spectrum = np.abs(np.fft.rfft(x)) ** 2
+    f = np.fft.rfftfreq(len(x), 1 / PWM_FS)
+    tone = np.abs(f - tone_Hz) < 50
+    band = (f > 50) & (f < AUDIO_FS / 2)
+    signal = np.sum(spectrum[tone])
+    noise = np.sum(spectrum[band & ~tone])
+    return 10 * np.log10(signal / noise), f, spectrum
+
+
+tone_Hz = 1000
+n = np.arange(AUDIO_FS // 2)
+samples = np.round(16000 * np.sin(2 * np.pi * tone_Hz * n / AUDIO_FS))
+
+for noise_shaping in [False, True]:
+    snr, f, spectrum = audio_band_snr(interpolate(samples, noise_shaping), tone_Hz)
+    label = "noise shaped" if noise_shaping else "plain"
+    print(f"{label:12s} pwm_max={PWM_MAX} audio band SNR: {snr:5.1f}dB ({(snr - 1.76) / 6.02:4.1f} bits)")
+    plt.plot(f, 10 * np.log10(spectrum + 1e-12), label=label)
+
+plt.axvline(AUDIO_FS / 2, color="grey", linestyle="dashed")
+plt.xlabel("Frequency (Hz)")
+plt.ylabel("Power (dB)")
+plt.grid(True)
+plt.legend()
+plt.show()
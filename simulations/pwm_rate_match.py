@@ -0,0 +1,103 @@
+import random
+
+# Model of the rate matching in pwm_audio_sink_push. The ADC produces a block
+# of audio every 2048/480000 s, the DSP pushes it a variable time later and
+# the PWM plays blocks at system_clock/(pwm_max+1). Prints the underruns with
+# and without the loop and the correction it settles on for some system
+# clocks.
+
+BLOCK = 64  # PWM_AUDIO_NUM_SAMPLES
+INTERPOLATION_RATE = 16
+OUT = BLOCK * INTERPOLATION_RATE
+LATENCY = 2  # pwm_latency
+RING = 4  # pwm_ring_size
+TARGET = LATENCY * BLOCK
+MAX_ADJUST = (1 << 24) // 100
+ADC_T = 2048 / 480000
+
+
+def run(sys_clk, seconds, control=True, jitter=(0.5e-3, 3.5e-3)):
+  pwm_max = sys_clk // 240000 - 1
+  pwm_t = (pwm_max + 1) / sys_clk
+  random.seed(1)
+
+  started = 0
+  next_slot = LATENCY
+  queued = set()
+  block_start = 0.0
+  last_silent = True
+  underruns = 0
+  overruns = 0
+  pending = 0
+  phase = 0
+  avg_level = 0
+  integral = 0
+  priming = True
+  adjusts = []
+
+  k = 0
+  while k * ADC_T < seconds:
+    k += 1
+    t = k * ADC_T + random.uniform(*jitter)
+
+    # play blocks up to the time of the push
+    while block_start + OUT * pwm_t <= t:
+      queued.discard(started)
+      started += 1
+      block_start += OUT * pwm_t
+      silent = started not in queued
+      if silent and not last_silent:
+        underruns += 1
+      last_silent = silent
+
+    if next_slot - started <= 0:
+      next_slot = started + LATENCY
+      pending = 0
+      priming = True
+
+    remaining = OUT - int((t - block_start) / pwm_t)
+    level = (next_slot - started - 1) * BLOCK + remaining // INTERPOLATION_RATE + pending
+    if priming:
+      padding = min(TARGET - level, BLOCK) if control else 0
+      if padding > 0:
+        pending += padding
+        level += padding
+      avg_level = TARGET << 8
+      phase = 0
+      priming = False
+
+    avg_level += ((level << 8) - avg_level) >> 4
+    error = avg_level - (TARGET << 8)
+    integral = max(-(MAX_ADJUST << 12), min(MAX_ADJUST << 12, integral + error))
+    adjust = max(-MAX_ADJUST, min(MAX_ADJUST, (error << 4) + (integral >> 12)))
+    if not control:
+      adjust = 0
+    step = (1 << 24) + adjust
+    adjusts.append(adjust)
+
+    for _ in range(BLOCK):
+      while phase < (1 << 24):
+        pending += 1
+        phase += step
+      phase -= 1 << 24
+
+    while pending >= BLOCK:
+      if next_slot - started >= RING:
+        overruns += 1
+      else:
+        queued.add(next_slot)
+        next_slot += 1
+      pending -= BLOCK
+
+  settled = adjusts[len(adjusts) // 2:]
+  ppm = sum(settled) / len(settled) * 1e6 / (1 << 24)
+  clock_error = ((pwm_max + 1) * 240000 / sys_clk - 1) * 1e6
+  return underruns, overruns, ppm, clock_error
+
+
+print("system clock  clock error  underruns (fixed)  underruns  overruns  correction")
+for sys_clk in [48200000, 125000000, 133000000, 150000000, 200000000]:
+  fixed, _, _, _ = run(sys_clk, 300, control=False)
+  underruns, overruns, ppm, clock_error = run(sys_clk, 300)
+  print("%9.1f MHz %8.0f ppm %18u %10u %9u %7.0f ppm" %
+        (sys_clk / 1e6, clock_error, fixed, underruns, overruns, ppm))
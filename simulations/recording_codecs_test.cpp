@@ -0,0 +1,51 @@
+#include "../codecs/ima_adpcm.h"
+#include "../codecs/rice_iq.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+//usage: recording_codecs_test adpcm|rice input.raw output.bin
+//input is little endian int16, mono audio for adpcm, interleaved IQ for rice
+int main(int argc, char *argv[])
+{
+  if(argc != 4) return 1;
+  FILE *input = fopen(argv[2], "rb");
+  FILE *output = fopen(argv[3], "wb");
+  if(!input || !output) return 1;
+
+  std::vector<int16_t> samples;
+  int16_t sample;
+  while(fread(&sample, sizeof(sample), 1, input) == 1) samples.push_back(sample);
+
+  std::vector<uint8_t> encoded;
+  const auto start = std::chrono::steady_clock::now();
+  if(strcmp(argv[1], "adpcm") == 0)
+  {
+    ima_adpcm_encoder encoder;
+    encoder.reset();
+    for(int16_t s : samples)
+    {
+      if(encoder.push(s))
+      {
+        encoded.insert(encoded.end(), encoder.get_block(), encoder.get_block() + ima_adpcm_encoder::block_size);
+      }
+    }
+  }
+  else
+  {
+    //one frame per adc block, the same as the receiver
+    const uint16_t pairs = 128;
+    uint8_t frame[2 + pairs * 4];
+    for(size_t idx = 0; idx + 2 * pairs <= samples.size(); idx += 2 * pairs)
+    {
+      const uint16_t length = rice_iq_encode(&samples[idx], pairs, frame);
+      encoded.insert(encoded.end(), frame, frame + length);
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  fwrite(encoded.data(), 1, encoded.size(), output);
+  printf("%.1f ns per sample\n", seconds * 1e9 / samples.size());
+  return 0;
+}
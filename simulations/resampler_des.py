@@ -0,0 +1,103 @@
+# Design of the polyphase resamplers used for USB audio
+#  15 kHz audio or IQ -> 48 kHz (16:5)
+#  30 kHz wideband IQ -> 48 kHz (8:5)
+# prints the coefficient tables for resampler.cpp and checks the fixed point
+# implementation for passband ripple and image rejection
+
+import numpy as np
+import scipy.signal as sig
+import matplotlib.pyplot as plt
+
+FS_OUT = 48000
+TAPS_PER_PHASE = 24
+COEFF_BITS = 14  # keeps the worst case accumulator inside 32 bits
+BLOCK_TIME = 64 / 15000  # one adc block
+
+
+def design(fs_in, up, passband, stopband):
+    # prototype low pass filter at the upsampled rate
+    h = sig.firwin(
+        up * TAPS_PER_PHASE,
+        (passband + stopband) / 2,
+        window=("kaiser", 7),
+        fs=fs_in * up,
+    )
+    h *= up  # restore the gain lost by zero stuffing
+
+    # split into phases, phase p uses taps p, p+up, p+2up ... reversed so that
+    # the taps line up with the input samples oldest first
+    phases = np.round(h.reshape(TAPS_PER_PHASE, up).T[:, ::-1] * (1 << COEFF_BITS)).astype(int)
+    assert np.max(np.abs(phases)) < (1 << COEFF_BITS)
+    assert 32768 * np.max(np.sum(np.abs(phases), axis=1)) < (1 << 31)
+    return h, phases
+
+
+def resample(x, phases, up, down, block):
+    """bit accurate model of resampler::process"""
+    history = np.zeros(TAPS_PER_PHASE - 1, dtype=int)
+    out = []
+    phase = 0
+    base = 0
+    for start in range(0, len(x), block):
+        n = len(x[start : start + block])
+        buf = np.concatenate((history, x[start : start + n]))
+        while base < n:
+            acc = int(np.dot(phases[phase], buf[base : base + TAPS_PER_PHASE]))
+            acc += 1 << (COEFF_BITS - 1)
+            out.append(np.clip(acc >> COEFF_BITS, -32768, 32767))
+            phase += down
+            if phase >= up:
+                phase -= up
+                base += 1
+        base -= n
+        history = buf[-(TAPS_PER_PHASE - 1) :]
+    return np.array(out)
+
+
+def check(name, fs_in, up, down, passband, stopband):
+    h, phases = design(fs_in, up, passband, stopband)
+    block = round(BLOCK_TIME * fs_in)
+    print(name)
+    print("  worst case sum of |taps| in a phase: %.3f" % (np.max(np.sum(np.abs(phases), axis=1)) / (1 << COEFF_BITS)))
+
+    worst_image = -200
+    ripple = []
+    for f in np.arange(passband / 12, passband + 1, passband / 12):
+        n = np.arange(fs_in // 2)
+        x = np.round(16000 * np.sin(2 * np.pi * f * n / fs_in)).astype(int)
+        y = resample(x, phases, up, down, block)[FS_OUT // 10 :]
+        window = np.blackman(len(y))
+        spectrum = np.abs(np.fft.rfft(y * window))
+        freqs = np.fft.rfftfreq(len(y), 1 / FS_OUT)
+        wanted = np.argmin(np.abs(freqs - f))
+        ripple.append(20 * np.log10(np.std(y) / np.std(x)))
+        mask = np.abs(freqs - f) > 100
+        worst_image = max(worst_image, 20 * np.log10(np.max(spectrum[mask]) / spectrum[wanted]))
+
+    print("  passband gain %.2f to %.2f dB up to %d Hz" % (min(ripple), max(ripple), passband))
+    print("  worst image or spur for tones up to %d Hz: %.1f dB" % (passband, worst_image))
+    outputs = block * up / down
+    print("  %.1f outputs, %d multiply accumulates per block per channel" % (outputs, outputs * TAPS_PER_PHASE))
+
+    print("  static const int16_t %s[%d][%d] = {" % (name, up, TAPS_PER_PHASE))
+    for p in phases:
+        print("    {" + ", ".join("%d" % c for c in p) + "},")
+    print("  };")
+
+    w, H = sig.freqz(h / up, worN=8192, fs=fs_in * up)
+    plt.plot(w, 20 * np.log10(np.abs(H) + 1e-12), label=name)
+
+
+# audio and narrow IQ, the first image of a 6 kHz tone lands at 15 - 6 = 9 kHz
+check("coefficients_15k_to_48k", 15000, 16, 5, 6000, 9000)
+
+# wideband IQ, the first image of a 12 kHz tone lands at 30 - 12 = 18 kHz
+check("coefficients_30k_to_48k", 30000, 8, 5, 12000, 18000)
+
+plt.xlim(0, FS_OUT / 2)
+plt.ylim(-100, 5)
+plt.xlabel("frequency (Hz)")
+plt.ylabel("gain (dB)")
+plt.title("USB resampler prototype filters")
+plt.legend()
+plt.show()
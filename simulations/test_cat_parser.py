@@ -0,0 +1,7 @@
+from subprocess import run
+
+#build and run CAT parser fuzz test and benchmark
+run(["g++", "-O2", "../cat_parser.cpp", "cat_parser_test.cpp", "-o", "cat_parser_test"], check=True)
+result = run("./cat_parser_test")
+run(["rm", "cat_parser_test"])
+exit(result.returncode)
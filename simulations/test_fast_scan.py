@@ -0,0 +1,7 @@
+from subprocess import run
+
+#build and run the fast scanner detection test
+run(["g++", "-O2", "../fast_scan.cpp", "../cic_corrections.cpp", "fast_scan_test.cpp", "-o", "fast_scan_test"], check=True)
+result = run("./fast_scan_test")
+run(["rm", "fast_scan_test"])
+exit(result.returncode)
@@ -0,0 +1,7 @@
+from subprocess import run
+
+#build and run the nco tuning plan test
+run(["g++", "-O2", "../nco_plan.cpp", "../clocks_pico.cpp", "nco_plan_test.cpp", "-o", "nco_plan_test"], check=True)
+result = run("./nco_plan_test")
+run(["rm", "nco_plan_test"])
+exit(result.returncode)
@@ -0,0 +1,47 @@
+import struct
+import wave
+import numpy as np
+from subprocess import run
+
+#build test harnesses
+run(["g++", "-O2", "../codecs/recording_reader.cpp", "../codecs/rice_iq.cpp", "playback_test.cpp", "-o", "playback_test"], check=True)
+run(["g++", "-O2", "../codecs/ima_adpcm.cpp", "../codecs/rice_iq.cpp", "recording_codecs_test.cpp", "-o", "recording_codecs_test"], check=True)
+
+def play(filename):
+  output = run(["./playback_test", filename], capture_output=True, text=True, check=True).stdout
+  return np.array(output.split(), dtype=int).reshape(-1, 2)
+
+#30kHz IQ with a carrier and noise, as recorded by the receiver
+rng = np.random.default_rng(2)
+n = 128 * 500
+t = np.arange(n) / 30000
+iq = rng.normal(0, 50, (n, 2))
+iq[:, 0] += 2000 * np.cos(2 * np.pi * 1200 * t)
+iq[:, 1] += 2000 * np.sin(2 * np.pi * 1200 * t)
+iq = np.clip(iq, -32768, 32767).astype("<i2")
+
+#stereo wav, a plain 44 byte header exercises the chunk walk
+with wave.open("playback.wav", "wb") as w:
+  w.setnchannels(2)
+  w.setsampwidth(2)
+  w.setframerate(30000)
+  w.writeframes(iq.tobytes())
+assert np.array_equal(play("playback.wav"), iq)
+print("wav playback: bit exact")
+
+#lossless .riq with the 512 byte header written by sdcard.cpp
+iq.tofile("codec_in.raw")
+run(["./recording_codecs_test", "rice", "codec_in.raw", "codec_out.bin"], check=True, capture_output=True)
+frames = open("codec_out.bin", "rb").read()
+header = struct.pack("<4sHIHHI", b"PRIQ", 1, 30000, 2, 128, len(frames)).ljust(512, b"\0")
+open("playback.riq", "wb").write(header + frames)
+assert np.array_equal(play("playback.riq"), iq)
+print("riq playback: bit exact")
+
+#a truncated recording plays up to the last whole frame
+open("playback.riq", "wb").write(header + frames[:len(frames) // 2])
+played = play("playback.riq")
+assert len(played) > 0 and np.array_equal(played, iq[:len(played)])
+print("truncated riq: %u of %u pairs" % (len(played), len(iq)))
+
+run(["rm", "playback.wav", "playback.riq", "codec_in.raw", "codec_out.bin", "playback_test", "recording_codecs_test"])
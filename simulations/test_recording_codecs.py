@@ -0,0 +1,72 @@
+import sys
+import wave
+import numpy as np
+from subprocess import run
+
+sys.path.append("../utils")
+from decode_recording import decode
+
+#build test harness
+run(["g++", "-O2", "../codecs/ima_adpcm.cpp", "../codecs/rice_iq.cpp", "recording_codecs_test.cpp", "-o", "recording_codecs_test"], check=True)
+
+step_table = [
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767]
+index_table = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+
+def decode_adpcm(data, block_size=256):
+  """reference decoder for mono IMA-ADPCM WAV blocks"""
+  output = []
+  for offset in range(0, len(data) - block_size + 1, block_size):
+    block = data[offset:offset + block_size]
+    predictor = int.from_bytes(block[0:2], "little", signed=True)
+    index = block[2]
+    output.append(predictor)
+    for byte in block[4:]:
+      for code in (byte & 0xf, byte >> 4):
+        step = step_table[index]
+        delta = step >> 3
+        if code & 4: delta += step
+        if code & 2: delta += step >> 1
+        if code & 1: delta += step >> 2
+        predictor = max(-32768, min(32767, predictor - delta if code & 8 else predictor + delta))
+        index = max(0, min(88, index + index_table[code]))
+        output.append(predictor)
+  return np.array(output)
+
+def snr_dB(reference, test):
+  noise = reference[:len(test)] - test
+  return 10 * np.log10(np.sum(reference[:len(test)].astype(float)**2) / np.sum(noise.astype(float)**2))
+
+#audio: demodulated speech recording
+with wave.open("test.wav", "rb") as w:
+  audio = np.frombuffer(w.readframes(w.getnframes()), dtype="<i2")
+audio.tofile("codec_in.raw")
+print("adpcm:", run(["./recording_codecs_test", "adpcm", "codec_in.raw", "codec_out.bin"], capture_output=True, text=True).stdout.strip())
+encoded = open("codec_out.bin", "rb").read()
+decoded = decode_adpcm(encoded)
+print("  compression ratio %.2f, SNR %.1f dB" % (len(audio) * 2 / len(encoded), snr_dB(audio, decoded)))
+assert snr_dB(audio, decoded) > 20
+
+#IQ: receiver noise floor with a few carriers, and full scale noise which can't be compressed
+rng = np.random.default_rng(1)
+n = 128 * 2000
+t = np.arange(n) / 30000
+for name, level in (("noise floor", 30), ("strong signals", 300), ("full scale noise", 20000)):
+  iq = rng.normal(0, level, (n, 2))
+  iq[:, 0] += 3000 * np.cos(2 * np.pi * 1000 * t) + 500 * np.cos(2 * np.pi * 7300 * t)
+  iq[:, 1] += 3000 * np.sin(2 * np.pi * 1000 * t) + 500 * np.sin(2 * np.pi * 7300 * t)
+  iq = np.clip(iq, -32768, 32767).astype("<i2")
+  iq.tofile("codec_in.raw")
+  timing = run(["./recording_codecs_test", "rice", "codec_in.raw", "codec_out.bin"], capture_output=True, text=True).stdout.strip()
+  encoded = open("codec_out.bin", "rb").read()
+  decoded = decode(encoded, 128)
+  assert np.array_equal(decoded, iq), name
+  print("rice %s: lossless, compression ratio %.2f, %s" % (name, iq.nbytes / len(encoded), timing))
+
+run(["rm", "codec_in.raw", "codec_out.bin", "recording_codecs_test"])
@@ -82,12 +82,12 @@ extern "C" {
 #endif
 
 //------------- CLASS -------------//
-#define CFG_TUD_CDC               1
+#define CFG_TUD_CDC               3 // debug (stdio), CAT and telemetry, see usb_serial.h
 #define CFG_TUD_MSC               0
 #define CFG_TUD_HID               0
 #define CFG_TUD_MIDI              0
 #define CFG_TUD_AUDIO             1
-#define CFG_TUD_VENDOR            0
+#define CFG_TUD_VENDOR            1
 
 //--------------------------------------------------------------------
 // AUDIO CLASS DRIVER CONFIGURATION
@@ -95,7 +95,7 @@ extern "C" {
 
 // Have a look into audio_device.h for all configurations
 
-#define CFG_TUD_AUDIO_FUNC_1_SAMPLE_RATE                              (15000) // make sure this matches rx_definitions.h:audio_sample_rate
+#define CFG_TUD_AUDIO_FUNC_1_SAMPLE_RATE                              (48000) // must match resampler.h:resampler_output_rate, checked in rx.cpp
 #define CFG_TUD_AUDIO_FUNC_1_DESC_LEN                                 TUD_AUDIO_PICORX_DESC_LEN
 #define CFG_TUD_AUDIO_FUNC_1_N_AS_INT                                 1                                       // Number of Standard AS Interface Descriptors (4.9.1) defined per audio function - this is required to be able to remember the current alternate settings of these interfaces - We restrict us here to have a constant number for all audio functions (which means this has to be the maximum number of AS interfaces an audio function has and a second audio function with less AS interfaces just wastes a few bytes)
 #define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ                              64                                      // Size of control request buffer
@@ -107,9 +107,13 @@ extern "C" {
 #define CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX                             CFG_TUD_AUDIO_EP_SZ_IN                  // Maximum EP IN size for all AS alternate settings used
 #define CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ                          (TUD_OPT_HIGH_SPEED ? 16 : 2) * CFG_TUD_AUDIO_EP_SZ_IN
 
-// CDC FIFO size of TX and RX
-#define CFG_TUD_CDC_RX_BUFSIZE                    64
-#define CFG_TUD_CDC_TX_BUFSIZE                    64
+// CDC FIFO size of TX and RX, per port. TX holds the largest CAT spectrum frame
+#define CFG_TUD_CDC_RX_BUFSIZE                    256
+#define CFG_TUD_CDC_TX_BUFSIZE                    1024
+
+// Vendor FIFO size of TX and RX, TX holds a spectrum frame and a few IQ frames
+#define CFG_TUD_VENDOR_RX_BUFSIZE                 64
+#define CFG_TUD_VENDOR_TX_BUFSIZE                 2048
 
 #ifdef __cplusplus
 }
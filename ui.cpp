@@ -9,6 +9,9 @@
 #include "pico/util/queue.h"
 #include "fonts.h"
 #include "settings.h"
+#include "memory_index.h"
+#include "fast_scan.h"
+#include "panorama.h"
 #include "rotary_encoder.h"
 #include "utils.h"
 
@@ -1148,6 +1151,7 @@ void ui::autorestore()
 {
   autosave_restore_settings(settings);
   apply_settings(false);
+  memory_index_build();
 
   //reset display timeout
   display_timeout_max = timeout_lookup[settings.global.display_timeout];
@@ -1277,13 +1281,8 @@ bool ui::memory_recall(bool &ok)
 
     //skip blank channels
     load_and_update_display = true;
-    for(uint16_t i = 0; i<num_chans; i++)
-    {
-      memory_channel = get_channel(select);
-      if(memory_channel.channel.frequency != 0) break;
-      select++;
-      if(select > max) select = min;
-    }
+    if(!memory_index_valid(select)) select = memory_index_next(select, 1);
+    memory_channel = get_channel(select);
 
     state = active;
   }
@@ -1294,14 +1293,8 @@ bool ui::memory_recall(bool &ok)
     load_and_update_display = encoder_position != 0;
 
     //skip blank channels
-    for(uint16_t i = 0; i<num_chans; i++)
-    {
-      memory_channel = get_channel(select);
-      if(memory_channel.channel.frequency != 0) break;
-      select += encoder_position>0?1:-1;
-      if(select < min) select = max;
-      if(select > max) select = min;
-    }
+    if(!memory_index_valid(select)) select = memory_index_next(select, encoder_position>0?1:-1);
+    memory_channel = get_channel(select);
 
     //ok
     if(encoder_button.is_pressed()||menu_button.is_pressed()){
@@ -1387,8 +1380,6 @@ bool ui::memory_recall(bool &ok)
 // Scan across the stored memories
 bool ui::memory_scan(bool &ok)
 {
-  const int32_t min = 0;
-  const int32_t max = num_chans-1;
   static int32_t select = 0;
   static s_channel_settings stored_settings;
   bool load = false;
@@ -1407,12 +1398,7 @@ bool ui::memory_scan(bool &ok)
     stored_settings = settings.channel;
 
     //skip blank channels
-    for(uint16_t i = 0; i<num_chans; i++)
-    {
-      if(get_channel(select).channel.frequency != 0) break;
-      select++;
-      if(select > max) select = min;
-    }
+    if(!memory_index_valid(select)) select = memory_index_next(select, 1);
 
     load = true;
     update_display = true;
@@ -1468,13 +1454,7 @@ bool ui::memory_scan(bool &ok)
       else direction = scan_speed>0?1:-1;
 
       //skip blank channels
-      for(uint16_t i = 0; i<num_chans; i++)
-      {
-        select += direction;
-        if(select < min) select = max;
-        if(select > max) select = min;
-        if(get_channel(select).channel.frequency != 0) break;
-      }
+      select = memory_index_next(select, direction);
       update_display = true;
       load = true;
     }
@@ -1669,8 +1649,24 @@ bool ui::frequency_scan(bool &ok)
       if(scan_speed == 0) direction = pos_change>0?1:-1;
       else direction = scan_speed>0?1:-1;
 
+      //while scanning, check every channel in the spectrum on the way to the
+      //band edge and go straight to the first occupied one, or skip the span
+      const uint32_t step_Hz = step_sizes[settings.channel.step];
+      const uint32_t to_edge_Hz = direction > 0 ? settings.channel.max_frequency - settings.channel.frequency :
+                                                  settings.channel.frequency - settings.channel.min_frequency;
+      uint32_t channels = 1;
+      int16_t fft_bin;
+      const int16_t *capture = scan_speed && to_edge_Hz >= 2 * step_Hz ? receiver.rx_dsp_inst.try_acquire_capture(fft_bin) : NULL;
+      if(capture)
+      {
+        const uint16_t span = std::min(fast_scan_span(step_Hz), (uint16_t)std::min(to_edge_Hz / step_Hz, (uint32_t)UINT16_MAX));
+        const uint16_t occupied = fast_scan_find(capture, fft_bin, step_Hz, direction, span);
+        receiver.rx_dsp_inst.release_capture();
+        channels = occupied ? occupied : span;
+      }
+
       //update frequency
-      settings.channel.frequency += direction * step_sizes[settings.channel.step];
+      settings.channel.frequency += direction * channels * step_Hz;
 
       if (settings.channel.frequency > settings.channel.max_frequency)
           settings.channel.frequency = settings.channel.min_frequency;
@@ -2259,7 +2255,8 @@ bool ui::main_menu(bool & ok)
                      "Impulse\nBlanker#Auto "
                      "Notch#De-\nEmphasis#Bass#Treble#IQ\nCorrection#Spectrum#"
                      "Aux\nDisplay#Band Start#Band Stop#Frequency\nStep#CW "
-                     "Tone\nFrequency#USB Stream#SD card\nrecord#HW Config#",
+                     "Tone\nFrequency#USB Stream#SD card\nrecord#SD card\nplayback#SD card\ntimeshift#"
+                     "Timeshift\nminutes#SD card\nsquelch#HW Config#",
                      &menu_selection, ok)) {
         if(ok)
         {
@@ -2370,12 +2367,36 @@ bool ui::main_menu(bool & ok)
             if(changed) apply_settings(false);
             break;
           case 24 :
-            done = bit_entry("USB\nStream", "Audio#Raw IQ#", settings.global.usb_stream, ok);
+            done = enumerate_entry("USB\nStream", "Audio#Raw IQ#Wide IQ#", settings.global.usb_stream, ok, changed);
             break;
           case 25 :
-            done = bit_entry("SD card\nrecord", "Off#On#", settings.global.sd_card_save, ok);
+            done = enumerate_entry("SD card\nrecord", "Off#Audio#IQ#ADPCM#IQ Rice#", settings.global.sd_card_save, ok, changed);
             break;
           case 26 :
+          {
+            //recording number to play, 0 stops playback
+            static int32_t recording = -1;
+            if(recording < 0) recording = sd_card_playback ? sd_card_playback : std::max<int32_t>(std::min<int32_t>(settings.global.sd_card_counter - 1, 32767), 0);
+            done = number_entry("SD card\nplayback", "%i", 0, 32767, 1, recording, ok, changed);
+            if(done)
+            {
+              if(ok) sd_card_playback = recording;
+              recording = -1;
+            }
+            break;
+          }
+          case 27 :
+            //compressed IQ frames don't split across segments, so no IQ Rice
+            done = enumerate_entry("SD card\ntimeshift", "Off#Audio#IQ#ADPCM#", settings.global.sd_card_timeshift, ok, changed);
+            break;
+          case 28 :
+            done = number_entry("Timeshift\nminutes", "%i", 1, 10, 1, settings.global.sd_card_timeshift_minutes, ok, changed);
+            break;
+          case 29 :
+            //record only while the squelch is open, a new file after each hang time
+            done = enumerate_entry("SD card\nsquelch", "Off#1s#2s#5s#10s#30s#", settings.global.sd_card_squelch, ok, changed);
+            break;
+          case 30 :
             done = configuration_menu(ok);
             break;
         }
@@ -2400,7 +2421,7 @@ bool ui::spectrum_menu(bool & ok)
     //chose menu item
     if(ui_state == select_menu_item)
     {
-      if(menu_entry("Menu", "Spectrum\nZoom#Spectrum\nSmoothing#Spectrum\nHold#", &menu_selection, ok))
+      if(menu_entry("Menu", "Spectrum\nZoom#Spectrum\nSmoothing#Spectrum\nHold#Panorama\nStart#Panorama\nStop#Panorama\nSettle#Panorama\nDwell#SD card\nsurvey#Survey band 1\nstart#Survey band 1\nstop#Survey band 2\nstart#Survey band 2\nstop#Survey band 3\nstart#Survey band 3\nstop#Survey band 4\nstart#Survey band 4\nstop#", &menu_selection, ok))
       {
         if(ok)
         {
@@ -2436,6 +2457,45 @@ bool ui::spectrum_menu(bool & ok)
           case 2:
             done = bit_entry("Spectrum\nHold", "Off#On#", settings.global.spectrum_hold, ok);
             break;
+          case 3:
+            done = number_entry("Panorama\nStart MHz", "%i", 0, 29, 1, settings.global.panorama_start_MHz, ok, changed);
+            break;
+          case 4:
+            done = number_entry("Panorama\nStop MHz", "%i", 1, 30, 1, settings.global.panorama_stop_MHz, ok, changed);
+            break;
+          case 5:
+            done = number_entry("Panorama\nSettle ms", "%i", 1, 100, 1, settings.global.panorama_settle_ms, ok, changed);
+            break;
+          case 6:
+            done = number_entry("Panorama\nDwell ms", "%i", 10, 250, 10, settings.global.panorama_dwell_ms, ok, changed);
+            break;
+          case 7:
+            done = enumerate_entry("SD card\nsurvey", "Off#1 min#5 min#15 min#60 min#", settings.global.sd_card_survey, ok, changed);
+            break;
+          case 8:
+            done = number_entry("Survey band 1\nstart MHz", "%i", 0, 29, 1, settings.global.survey_band_start_MHz[0], ok, changed);
+            break;
+          case 9:
+            done = number_entry("Survey band 1\nstop MHz", "%i", 0, 30, 1, settings.global.survey_band_stop_MHz[0], ok, changed);
+            break;
+          case 10:
+            done = number_entry("Survey band 2\nstart MHz", "%i", 0, 29, 1, settings.global.survey_band_start_MHz[1], ok, changed);
+            break;
+          case 11:
+            done = number_entry("Survey band 2\nstop MHz", "%i", 0, 30, 1, settings.global.survey_band_stop_MHz[1], ok, changed);
+            break;
+          case 12:
+            done = number_entry("Survey band 3\nstart MHz", "%i", 0, 29, 1, settings.global.survey_band_start_MHz[2], ok, changed);
+            break;
+          case 13:
+            done = number_entry("Survey band 3\nstop MHz", "%i", 0, 30, 1, settings.global.survey_band_stop_MHz[2], ok, changed);
+            break;
+          case 14:
+            done = number_entry("Survey band 4\nstart MHz", "%i", 0, 29, 1, settings.global.survey_band_start_MHz[3], ok, changed);
+            break;
+          case 15:
+            done = number_entry("Survey band 4\nstop MHz", "%i", 0, 30, 1, settings.global.survey_band_stop_MHz[3], ok, changed);
+            break;
         }
         if(done)
         {
@@ -2559,13 +2619,90 @@ bool ui::do_splash()
 
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Panorama, sweeps the receiver across a range and shows the stitched spectrum
+////////////////////////////////////////////////////////////////////////////////
+bool ui::panorama_scan(bool &ok)
+{
+  static uint8_t cursor = 64;
+
+  if(!panorama_active())
+  {
+    //while surveying, sweep each survey band in turn, a band is unused unless
+    //its stop is above its start
+    s_panorama_band bands[panorama_max_bands];
+    uint8_t num_bands = 0;
+    for(uint8_t band = 0; settings.global.sd_card_survey && band < panorama_max_bands; ++band)
+    {
+      if(settings.global.survey_band_stop_MHz[band] <= settings.global.survey_band_start_MHz[band]) continue;
+      bands[num_bands].start_Hz = settings.global.survey_band_start_MHz[band] * 1000000u;
+      bands[num_bands].stop_Hz = settings.global.survey_band_stop_MHz[band] * 1000000u;
+      ++num_bands;
+    }
+    if(!num_bands)
+    {
+      bands[0].start_Hz = settings.global.panorama_start_MHz * 1000000u;
+      bands[0].stop_Hz = std::max(settings.global.panorama_stop_MHz * 1000000u, bands[0].start_Hz + 1000000u);
+      num_bands = 1;
+    }
+    panorama_start(receiver, settings_to_apply, bands, num_bands,
+                   settings.global.panorama_settle_ms, settings.global.panorama_dwell_ms);
+    cursor = 64;
+  }
+
+  //encoder moves the cursor, encoder button tunes to it
+  const int32_t pos_change = main_encoder.get_change();
+  cursor = std::min(std::max((int32_t)cursor + pos_change, (int32_t)0), (int32_t)127);
+
+  const s_panorama_status panorama = panorama_status();
+  const uint32_t cursor_Hz = panorama_pixel_frequency(2 * cursor);
+
+  const bool tune = encoder_button.is_pressed();
+  if(tune || back_button.is_pressed())
+  {
+    ok = tune;
+    panorama_stop();
+    if(ok)
+    {
+      const uint32_t step_Hz = step_sizes[settings.channel.step];
+      settings.channel.frequency = (cursor_Hz + step_Hz / 2) / step_Hz * step_Hz;
+      settings.channel.frequency = std::min(std::max(settings.channel.frequency, settings.channel.min_frequency), settings.channel.max_frequency);
+      autosave();
+    }
+    //restores the volume and frequency
+    apply_settings(false);
+    return true;
+  }
+
+  char buff[22];
+  display_clear();
+  display_print_str("Panorama");
+  snprintf(buff, sizeof(buff), " %u-%uMHz\n", (unsigned)(panorama.start_Hz / 1000000u), (unsigned)(panorama.stop_Hz / 1000000u));
+  display_print_str(buff);
+  display_print_freq('.', cursor_Hz);
+  if(panorama.sweep_ms)
+  {
+    snprintf(buff, sizeof(buff), " %lu.%02luMHz/s\n", panorama.rate_kHz_per_s / 1000u, panorama.rate_kHz_per_s % 1000u / 10u);
+  }
+  else
+  {
+    snprintf(buff, sizeof(buff), " %u/%u\n", panorama.segment, panorama.segments);
+  }
+  display_print_str(buff);
+  draw_spectrum(false, 24, 63);
+  ssd1306_draw_line(&disp, cursor, 24, cursor, 63, 2);
+  display_show();
+
+  return false;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // This is the main UI loop. Should get called about 10 times/second
 ////////////////////////////////////////////////////////////////////////////////
 void ui::do_ui(void)
 {
     bool update_settings = false;
-    enum e_ui_state {splash, idle, menu, recall, sleep, memory_scanner, frequency_scanner};
+    enum e_ui_state {splash, idle, menu, recall, sleep, memory_scanner, frequency_scanner, panorama};
     static e_ui_state ui_state = splash;
     const uint8_t num_display_options = 8;
     static bool view_changed = false;
@@ -2713,6 +2850,17 @@ void ui::do_ui(void)
     {
       bool ok = false;
       if(frequency_scan(ok))
+      {
+        ui_state = panorama;
+        display_time = time_us_32();
+      }
+    }
+
+    //sweep a wide range
+    else if(ui_state == panorama)
+    {
+      bool ok = false;
+      if(panorama_scan(ok))
       {
         ui_state = idle;
         display_time = time_us_32();
@@ -2739,6 +2887,12 @@ void ui::do_ui(void)
       waterfall_inst.powerOn(0);
     }
 
+    //erase ahead of the autosave log while nothing is being saved
+    if(ui_state == idle || ui_state == sleep)
+    {
+      autosave_erase_idle(settings, receiver, settings_to_apply);
+    }
+
     //apply settings to receiver (without saving)
     if (update_settings)
     {
@@ -133,6 +133,7 @@ class ui
                               const char* legend = 0, const char labels[][5] = NULL
                               );
   bool frequency_scan(bool &ok);
+  bool panorama_scan(bool &ok);
 
 
   bool frequency_autosave_pending = false;
@@ -179,6 +180,7 @@ class ui
   u8g2_t u8g2;
 
   bool sd_card_icon;
+  uint32_t sd_card_playback = 0;
 
   public:
 
@@ -187,6 +189,8 @@ class ui
   void do_ui(void);
   void set_sd_card_icon(bool en);
   void update_sdcard_counter(uint32_t c);
+  uint32_t get_sdcard_playback(){return sd_card_playback;};
+  void stop_sdcard_playback(){sd_card_playback = 0;};
   ui(rx_settings& _settings_to_apply, rx_status& _status, rx& _receiver,
      uint8_t* _spectrum, uint8_t* _audio, uint8_t& _dB10, uint8_t& _zoom,
      waterfall& _waterfall_inst);
@@ -29,12 +29,16 @@
 /* A combination of interfaces must have a unique product id, since PC will save device driver after the first plug.
  * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
  *
- * Auto ProductID layout's Bitmap:
- *   [MSB]     AUDIO | MIDI | HID | MSC | CDC          [LSB]
+ * Auto ProductID layout's Bitmap, CDC is a count of up to 3 ports:
+ *   [MSB]     VENDOR | AUDIO | MIDI | HID | MSC | CDC (2 bits)     [LSB]
  */
 #define _PID_MAP(itf, n)  ( (CFG_TUD_##itf) << (n) )
-#define USB_PID           (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(MSC, 1) | _PID_MAP(HID, 2) | \
-    _PID_MAP(MIDI, 3) | _PID_MAP(AUDIO, 4) | _PID_MAP(VENDOR, 5) )
+#define USB_PID           (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(MSC, 2) | _PID_MAP(HID, 3) | \
+    _PID_MAP(MIDI, 4) | _PID_MAP(AUDIO, 5) | _PID_MAP(VENDOR, 6) )
+
+#if CFG_TUD_CDC > 3 || CFG_TUD_MSC > 1 || CFG_TUD_HID > 1 || CFG_TUD_MIDI > 1 || CFG_TUD_AUDIO > 1 || CFG_TUD_VENDOR > 1
+#error "interface counts don't fit the product id bitmap"
+#endif
 
 //--------------------------------------------------------------------+
 // Device Descriptors
@@ -77,17 +81,30 @@ enum
 {
   ITF_NUM_AUDIO_CONTROL = 0,
   ITF_NUM_AUDIO_STREAMING,
-  ITF_NUM_CDC,
-  ITF_NUM_CDC_DATA,
+  ITF_NUM_CDC_DEBUG,
+  ITF_NUM_CDC_DEBUG_DATA,
+  ITF_NUM_CDC_CAT,
+  ITF_NUM_CDC_CAT_DATA,
+  ITF_NUM_CDC_TELEMETRY,
+  ITF_NUM_CDC_TELEMETRY_DATA,
+  ITF_NUM_VENDOR,
   ITF_NUM_TOTAL
 };
 
-#define CONFIG_TOTAL_LEN    	(TUD_CONFIG_DESC_LEN + CFG_TUD_AUDIO * TUD_AUDIO_PICORX_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN)
+#define CONFIG_TOTAL_LEN    	(TUD_CONFIG_DESC_LEN + CFG_TUD_AUDIO * TUD_AUDIO_PICORX_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN + CFG_TUD_VENDOR * TUD_VENDOR_DESC_LEN)
 
 #define EPNUM_AUDIO       0x01
 #define EPNUM_CDC_NOTIF   0x83
 #define EPNUM_CDC_OUT     0x04
 #define EPNUM_CDC_IN      0x84
+#define EPNUM_VENDOR_OUT  0x05
+#define EPNUM_VENDOR_IN   0x85
+#define EPNUM_CAT_NOTIF   0x86
+#define EPNUM_CAT_OUT     0x07
+#define EPNUM_CAT_IN      0x87
+#define EPNUM_TELEM_NOTIF 0x88
+#define EPNUM_TELEM_OUT   0x09
+#define EPNUM_TELEM_IN    0x89
 
 uint8_t const desc_configuration[] =
 {
@@ -98,7 +115,13 @@ uint8_t const desc_configuration[] =
     TUD_AUDIO_PICORX_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 0, CFG_TUD_AUDIO_FUNC_1_N_BYTES_PER_SAMPLE_TX, CFG_TUD_AUDIO_FUNC_1_N_BYTES_PER_SAMPLE_TX*8, 0x80 | EPNUM_AUDIO, CFG_TUD_AUDIO_EP_SZ_IN),
 
     // CDC: Interface number, string index, EP notification address and size, EP data address (out, in) and size.
-    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 6, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64)
+    // the order must match the port numbers in usb_serial.h, stdio uses the first port
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_DEBUG, 5, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_CAT, 7, EPNUM_CAT_NOTIF, 8, EPNUM_CAT_OUT, EPNUM_CAT_IN, 64),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_TELEMETRY, 8, EPNUM_TELEM_NOTIF, 8, EPNUM_TELEM_OUT, EPNUM_TELEM_IN, 64),
+
+    // Vendor: Interface number, string index, EP Out & IN address, EP size
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 6, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, 64)
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -130,7 +153,10 @@ char const *string_desc_arr[] =
         "PicoRX",                   // 2: Product
         NULL,                       // 3: Serials will use unique ID
         "UAC2",                     // 4: Audio Interface
-        "CDC",                      // 5: CDC Interface
+        "PicoRX Debug",             // 5: CDC Interface, stdio
+        "PicoRX Stream",            // 6: Vendor Interface
+        "PicoRX CAT",               // 7: CDC Interface, CAT control
+        "PicoRX Telemetry",         // 8: CDC Interface, status lines
 };
 
 static uint16_t _desc_str[32 + 1];
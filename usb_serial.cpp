@@ -0,0 +1,59 @@
+#include "usb_serial.h"
+
+#include <cstdio>
+#include <cstdarg>
+#include "tusb.h"
+
+static uint32_t dropped_bytes[CFG_TUD_CDC];
+
+uint32_t usb_serial_write(uint8_t port, const void *data, uint32_t length)
+{
+  const uint32_t written = tud_cdc_n_write(port, data, length);
+  tud_cdc_n_write_flush(port);
+  dropped_bytes[port] += length - written;
+  return written;
+}
+
+//write everything or nothing, so that a partial message never reaches the host
+bool usb_serial_write_all(uint8_t port, const void *data, uint32_t length)
+{
+  if(tud_cdc_n_write_available(port) < length)
+  {
+    dropped_bytes[port] += length;
+    return false;
+  }
+  usb_serial_write(port, data, length);
+  return true;
+}
+
+bool usb_serial_printf(uint8_t port, const char *format, ...)
+{
+  char message[256];
+  va_list args;
+  va_start(args, format);
+  const int length = vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  if(length <= 0) return false;
+  return usb_serial_write_all(port, message, length < (int)sizeof(message) ? length : sizeof(message) - 1);
+}
+
+uint32_t usb_serial_write_available(uint8_t port)
+{
+  return tud_cdc_n_write_available(port);
+}
+
+uint32_t usb_serial_read(uint8_t port, void *data, uint32_t length)
+{
+  if(!tud_cdc_n_available(port)) return 0;
+  return tud_cdc_n_read(port, data, length);
+}
+
+bool usb_serial_connected(uint8_t port)
+{
+  return tud_cdc_n_connected(port);
+}
+
+uint32_t usb_serial_dropped_bytes(uint8_t port)
+{
+  return dropped_bytes[port];
+}
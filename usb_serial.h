@@ -0,0 +1,23 @@
+#ifndef __USB_SERIAL_H__
+#define __USB_SERIAL_H__
+
+#include <cstdint>
+
+// the device exposes one CDC port per kind of traffic so that a debug
+// print can never delay or corrupt a CAT reply. Port 0 is used by the
+// pico stdio driver, so printf output lands on the debug port.
+const uint8_t USB_SERIAL_DEBUG = 0u;
+const uint8_t USB_SERIAL_CAT = 1u;
+const uint8_t USB_SERIAL_TELEMETRY = 2u;
+
+// all writes are non-blocking, data that does not fit in the CDC FIFO is
+// dropped and counted rather than waiting for the host
+uint32_t usb_serial_write(uint8_t port, const void *data, uint32_t length);
+bool usb_serial_write_all(uint8_t port, const void *data, uint32_t length);
+bool usb_serial_printf(uint8_t port, const char *format, ...) __attribute__((format(printf, 2, 3)));
+uint32_t usb_serial_write_available(uint8_t port);
+uint32_t usb_serial_read(uint8_t port, void *data, uint32_t length);
+bool usb_serial_connected(uint8_t port);
+uint32_t usb_serial_dropped_bytes(uint8_t port);
+
+#endif
@@ -74,4 +74,18 @@ char const* mode_to_str(uint8_t m) {
   } else {
     return "???";
   }
-}
\ No newline at end of file
+}
+
+//CRC-16/CCITT (polynomial 0x1021), bitwise to avoid a lookup table
+uint16_t crc16(const uint8_t data[], uint32_t length, uint16_t crc)
+{
+  for(uint32_t idx=0; idx<length; idx++)
+  {
+    crc ^= (uint16_t)data[idx] << 8;
+    for(uint8_t bit=0; bit<8; bit++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
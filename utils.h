@@ -9,5 +9,6 @@ uint16_t rectangular_2_magnitude(int16_t i, int16_t q);
 void rectangular_2_polar(int16_t i, int16_t q, uint16_t *mag, int16_t *phase);
 void initialise_luts();
 char const* mode_to_str(uint8_t m);
+uint16_t crc16(const uint8_t data[], uint32_t length, uint16_t crc = 0xffff);
 
 #endif
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Measure CAT round-trip latency, optionally while telemetry is streaming.
+
+usage: cat_latency.py CAT_PORT [TELEMETRY_PORT] [count]
+
+The CAT port is the second PicoRX serial port, telemetry is the third. When a
+telemetry port is given it is read continuously in a background thread so the
+device streams status lines for the whole measurement.
+"""
+
+import sys
+import time
+import threading
+import serial
+
+
+def read_telemetry(port, stop, counters):
+  with serial.Serial(port, timeout=0.1) as telemetry:
+    while not stop.is_set():
+      line = telemetry.readline()
+      if line:
+        counters["lines"] += 1
+        counters["bytes"] += len(line)
+
+
+def measure(cat, count):
+  latencies = []
+  for _ in range(count):
+    cat.reset_input_buffer()
+    start = time.perf_counter()
+    cat.write(b"FA;")
+    reply = cat.read_until(b";")
+    elapsed = time.perf_counter() - start
+    if reply.startswith(b"FA") and reply.endswith(b";"):
+      latencies.append(elapsed * 1e3)
+  return sorted(latencies)
+
+
+def main():
+  cat_port = sys.argv[1]
+  telemetry_port = sys.argv[2] if len(sys.argv) > 2 else None
+  count = int(sys.argv[3]) if len(sys.argv) > 3 else 1000
+
+  stop = threading.Event()
+  counters = {"lines": 0, "bytes": 0}
+  if telemetry_port:
+    thread = threading.Thread(target=read_telemetry, args=(telemetry_port, stop, counters))
+    thread.start()
+
+  with serial.Serial(cat_port, timeout=1) as cat:
+    start = time.time()
+    latencies = measure(cat, count)
+    duration = time.time() - start
+
+  stop.set()
+  if telemetry_port:
+    thread.join()
+
+  if not latencies:
+    print("no replies received")
+    return
+  percentile = lambda p: latencies[min(len(latencies) - 1, int(p * len(latencies)))]
+  print("%u/%u replies" % (len(latencies), count))
+  print("round trip ms: min %.2f median %.2f p99 %.2f max %.2f" %
+        (latencies[0], percentile(0.5), percentile(0.99), latencies[-1]))
+  if telemetry_port:
+    print("telemetry: %u lines, %.0f bytes/s" % (counters["lines"], counters["bytes"] / duration))
+
+
+if __name__ == "__main__":
+  main()
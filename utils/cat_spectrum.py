@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Remote panadapter client for the PicoRX CAT spectrum extension.
+
+Enables spectrum push (AI1 + ZSR) on the CAT serial port, decodes ZSD frames
+and reports bytes per frame and achieved frame rate.
+
+usage: cat_spectrum.py /dev/ttyACM0 [rate_Hz] [format]
+  format 0 = 8-bit delta coded, 1 = 4-bit delta coded
+"""
+
+import sys
+import time
+import serial
+
+BINS = 256
+ESCAPE = 0x8
+HEADER_SIZE = 8
+
+
+def decode(payload, four_bit):
+  nibbles = []
+  for byte in payload:
+    nibbles.append(byte >> 4)
+    nibbles.append(byte & 0xf)
+
+  spectrum = []
+  value = 0
+  idx = 0
+  while len(spectrum) < BINS:
+    nibble = nibbles[idx]
+    idx += 1
+    if nibble == ESCAPE:
+      if four_bit:
+        value = nibbles[idx]
+        idx += 1
+      else:
+        value = (nibbles[idx] << 4) | nibbles[idx+1]
+        idx += 2
+    else:
+      value += nibble - 16 if nibble > 7 else nibble
+    spectrum.append(value << 4 if four_bit else value)
+  return spectrum
+
+
+def read_frame(port):
+  """skip text replies until a ZSD header, then read the binary payload"""
+  window = b""
+  while not window.endswith(b"ZSD"):
+    byte = port.read(1)
+    if not byte:
+      return None
+    window = (window + byte)[-3:]
+  header = port.read(HEADER_SIZE - 3)
+  four_bit = header[0] == ord("1")
+  sequence, dB10 = header[1], header[2]
+  length = header[3] | (header[4] << 8)
+  payload = port.read(length)
+  if port.read(1) != b";":
+    return None
+  return sequence, dB10, four_bit, payload
+
+
+def main():
+  rate_Hz = int(sys.argv[2]) if len(sys.argv) > 2 else 20
+  four_bit = sys.argv[3] == "1" if len(sys.argv) > 3 else False
+
+  with serial.Serial(sys.argv[1], timeout=1) as port:
+    port.write(b"ZSR%02u%c;AI1;" % (rate_Hz, ord("1") if four_bit else ord("0")))
+    try:
+      frames = 0
+      total_bytes = 0
+      lost = 0
+      last_sequence = None
+      start = time.time()
+      while True:
+        frame = read_frame(port)
+        if frame is None:
+          continue
+        sequence, dB10, four_bit, payload = frame
+        decode(payload, four_bit)
+        if last_sequence is not None:
+          lost += (sequence - last_sequence - 1) & 0xff
+        last_sequence = sequence
+        frames += 1
+        total_bytes += HEADER_SIZE + len(payload) + 1
+        if frames % 20 == 0:
+          elapsed = time.time() - start
+          print("%.1f frames/s, %.0f bytes/frame, %u lost" % (frames/elapsed, total_bytes/frames, lost))
+    except KeyboardInterrupt:
+      pass
+    finally:
+      port.write(b"ZSR000;AI0;")
+
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Decode a losslessly compressed PicoRX IQ recording (.riq) to a stereo WAV.
+
+usage: decode_recording.py rec_000001_7074000_IQ.riq [output.wav]
+
+ADPCM audio recordings are standard IMA-ADPCM WAV files and play directly in
+most audio software, or can be converted with e.g. sox or ffmpeg.
+
+.riq layout: a 512 byte header ("PRIQ", version, sample rate, channels,
+data bytes, all little endian) followed by frames as described in
+codecs/rice_iq.h.
+"""
+
+import struct
+import sys
+import wave
+
+import numpy as np
+
+HEADER_SIZE = 512
+RICE_ESCAPE = 16
+RAW_FRAME = 0x8000
+
+
+class BitReader:
+  def __init__(self, data):
+    self.data = data
+    self.position = 0
+
+  def bit(self):
+    byte = self.data[self.position >> 3]
+    value = (byte >> (7 - (self.position & 7))) & 1
+    self.position += 1
+    return value
+
+  def bits(self, n):
+    value = 0
+    for _ in range(n):
+      value = (value << 1) | self.bit()
+    return value
+
+
+def unzigzag(u):
+  return (u >> 1) ^ -(u & 1)
+
+
+def decode_channel(reader, pairs):
+  order = reader.bits(2)
+  k = reader.bits(4)
+  samples = []
+  for idx in range(pairs):
+    if idx < order:
+      value = reader.bits(16)
+      samples.append(value - 65536 if value & 0x8000 else value)
+      continue
+    quotient = 0
+    while quotient < RICE_ESCAPE and reader.bit():
+      quotient += 1
+    if quotient == RICE_ESCAPE:
+      value = reader.bits(18)
+    else:
+      value = (quotient << k) | reader.bits(k)
+    x1 = samples[idx - 1] if idx > 0 else 0
+    x2 = samples[idx - 2] if idx > 1 else 0
+    prediction = (0, x1, 2 * x1 - x2)[order]
+    samples.append(prediction + unzigzag(value))
+  return samples
+
+
+def decode_frame(frame, pairs):
+  """pairs is the number of IQ pairs per frame"""
+  reader = BitReader(frame)
+  i = decode_channel(reader, pairs)
+  q = decode_channel(reader, pairs)
+  return np.column_stack((i, q)).astype(np.int16)
+
+
+def decode(data, pairs_per_frame):
+  frames = []
+  position = 0
+  while position + 2 <= len(data):
+    header = data[position] | (data[position + 1] << 8)
+    length = header & ~RAW_FRAME
+    frame = data[position + 2:position + 2 + length]
+    if len(frame) < length:
+      break
+    if header & RAW_FRAME:
+      frames.append(np.frombuffer(frame, dtype="<i2").reshape(-1, 2))
+    else:
+      frames.append(decode_frame(frame, pairs_per_frame))
+    position += 2 + length
+  return np.concatenate(frames) if frames else np.zeros((0, 2), dtype=np.int16)
+
+
+def main():
+  input_name = sys.argv[1]
+  output_name = sys.argv[2] if len(sys.argv) > 2 else input_name.rsplit(".", 1)[0] + ".wav"
+  with open(input_name, "rb") as f:
+    header = f.read(HEADER_SIZE)
+    magic, version, sample_rate, channels, pairs_per_frame, data_bytes = struct.unpack("<4sHIHHI", header[:18])
+    if magic != b"PRIQ" or version != 1:
+      raise ValueError("not a PicoRX IQ recording")
+    data = f.read(data_bytes)
+
+  samples = decode(data, pairs_per_frame)
+  with wave.open(output_name, "wb") as w:
+    w.setnchannels(channels)
+    w.setsampwidth(2)
+    w.setframerate(sample_rate)
+    w.writeframes(samples.astype("<i2").tobytes())
+  print("%u samples, compression ratio %.2f" % (len(samples), len(samples) * 4 / max(1, data_bytes)))
+
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Convert a PicoRX band-occupancy survey (survey_NNN.bin) to CSV or a heatmap.
+
+usage: survey_to_csv.py survey_000.bin [output.csv] [--heatmap output.png]
+
+The output is split by band, one CSV (and heatmap) per band with the band
+added to the name: output_band1.csv for the first panorama survey band,
+output_live.csv for the spectrum logged while listening. Each CSV has one
+row per channel per record: elapsed time in seconds, channel frequency in
+Hz, the tuned frequency and fft_bin of a live record (0 for a panorama band)
+and the average and peak level in dB. Levels are 20log10 of the spectrum
+magnitude, they are relative, not dBm. The cost of logging (time spent
+accumulating each sweep and writing each record) is printed at the end.
+
+layout: an 8 byte header ("PSRV", version and record header size, little
+endian) followed by records. Each record has a 26 byte header (seconds since
+the previous record, sweeps averaged, floor in dB, band, longest accumulate
+time in us, time in us taken to write the previous records, channels,
+fft_bin, tuned, start and stop frequency in Hz) then a byte per channel, the
+average above the floor in the high nibble and the peak above the average in
+the low nibble, in 3dB steps. The band is 0-3 for the panorama survey bands
+and 255 for the live spectrum. The frequency range is per record, the live
+spectrum follows the tuning.
+"""
+
+import struct
+import sys
+
+HEADER = "<4sHH"
+RECORD_HEADER = "<HHBBHHHhIII"
+LIVE_BAND = 255
+STEP_DB = 3
+
+
+def read_survey(data):
+  header_size = struct.calcsize(HEADER)
+  magic, version, record_header_size = struct.unpack(HEADER, data[:header_size])
+  if magic != b"PSRV" or version != 2 or record_header_size < struct.calcsize(RECORD_HEADER):
+    raise ValueError("not a PicoRX survey")
+
+  records = []
+  elapsed_s = 0
+  position = header_size
+  while position + record_header_size <= len(data):
+    (delta_s, sweeps, floor, band, cpu_us, write_us, channels, fft_bin,
+     tuned_Hz, start_Hz, stop_Hz) = struct.unpack_from(RECORD_HEADER, data, position)
+    position += record_header_size
+    if position + channels > len(data):
+      break
+    elapsed_s += delta_s
+    frequencies = [start_Hz + (stop_Hz - start_Hz) * (2 * idx + 1) // (2 * channels) for idx in range(channels)]
+    average = []
+    peak = []
+    for byte in data[position:position + channels]:
+      average.append(floor + STEP_DB * (byte >> 4))
+      peak.append(average[-1] + STEP_DB * (byte & 0xf))
+    position += channels
+    records.append({"time_s": elapsed_s, "band": band, "sweeps": sweeps, "cpu_us": cpu_us,
+                    "write_us": write_us, "fft_bin": fft_bin, "tuned_Hz": tuned_Hz,
+                    "frequencies": frequencies, "average": average, "peak": peak})
+  return records
+
+
+def band_name(band):
+  return "live" if band == LIVE_BAND else "band%u" % (band + 1)
+
+
+def write_csv(name, records):
+  with open(name, "w") as f:
+    f.write("time_s,frequency_Hz,tuned_Hz,fft_bin,average_dB,peak_dB\n")
+    for record in records:
+      for frequency, a, p in zip(record["frequencies"], record["average"], record["peak"]):
+        f.write("%u,%u,%u,%d,%u,%u\n" % (record["time_s"], frequency, record["tuned_Hz"],
+                                         record["fft_bin"], a, p))
+
+
+def write_heatmap(name, records):
+  import matplotlib.pyplot as plt
+  import numpy as np
+  plt.figure(figsize=(12, 6))
+  if all(record["frequencies"] == records[0]["frequencies"] for record in records):
+    levels = np.array([record["average"] for record in records])
+    frequencies = records[0]["frequencies"]
+    plt.imshow(levels, aspect="auto", origin="lower", interpolation="nearest",
+               extent=(frequencies[0] / 1e6, frequencies[-1] / 1e6,
+                       records[0]["time_s"] / 3600, records[-1]["time_s"] / 3600))
+  else:
+    # the range moved with the tuning, each record is drawn at its own frequencies
+    x = [frequency / 1e6 for record in records for frequency in record["frequencies"]]
+    y = [record["time_s"] / 3600 for record in records for _ in record["frequencies"]]
+    c = [level for record in records for level in record["average"]]
+    plt.scatter(x, y, c=c, s=4, marker="s")
+  plt.colorbar(label="average dB")
+  plt.xlabel("MHz")
+  plt.ylabel("hours")
+  plt.savefig(name, dpi=150)
+
+
+def main():
+  args = sys.argv[1:]
+  heatmap_name = None
+  if "--heatmap" in args:
+    idx = args.index("--heatmap")
+    heatmap_name = args[idx + 1]
+    del args[idx:idx + 2]
+  input_name = args[0]
+  output_name = args[1] if len(args) > 1 else input_name.rsplit(".", 1)[0] + ".csv"
+
+  with open(input_name, "rb") as f:
+    data = f.read()
+  records = read_survey(data)
+
+  bands = {}
+  for record in records:
+    bands.setdefault(record["band"], []).append(record)
+  for band, band_records in sorted(bands.items()):
+    stem, extension = output_name.rsplit(".", 1)
+    write_csv("%s_%s.%s" % (stem, band_name(band), extension), band_records)
+    if heatmap_name:
+      stem, extension = heatmap_name.rsplit(".", 1)
+      write_heatmap("%s_%s.%s" % (stem, band_name(band), extension), band_records)
+    print("%s: %u records" % (band_name(band), len(band_records)))
+
+  print("%u records, %u bytes" % (len(records), len(data)))
+  if records:
+    sweeps = sum(record["sweeps"] for record in records)
+    # each record reports the write time of the ones before it
+    writes = [record["write_us"] for record in records[1:] if record["write_us"]]
+    print("%u sweeps, accumulate max %u us" % (sweeps, max(record["cpu_us"] for record in records)))
+    if writes:
+      print("record write mean %u us, max %u us" % (sum(writes) // len(writes), max(writes)))
+
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+# Loopback and throughput test for the PicoRX vendor stream interface
+#
+# Enables the spectrum, IQ and status streams, then reports frames per
+# second, sequence gaps, ping round trip time and the CPU time the device
+# spends in its stream task.
+#
+# Usage: python vendor_stream_test.py [seconds]
+#
+# requires pyusb, on Windows the vendor interface needs a WinUSB driver
+
+import sys
+import time
+import struct
+import usb.core
+import usb.util
+
+VID = 0xCAFE
+PID = 0x4063  # 3 x CDC + AUDIO + VENDOR, see usb_descriptors.c
+
+HEADER = struct.Struct("<HBBHHII")
+STATUS = struct.Struct("<hHHHIIIIIII")
+MAGIC = 0x5250
+SPECTRUM, IQ, STATUS_FRAME = 1, 2, 3
+START, STOP, PING = 0x10, 0x11, 0x12
+NAMES = {SPECTRUM: "spectrum", IQ: "iq", STATUS_FRAME: "status"}
+
+
+def find_interface(dev):
+    for intf in dev.get_active_configuration():
+        if intf.bInterfaceClass == 0xFF:
+            ep_in = usb.util.find_descriptor(
+                intf, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == usb.util.ENDPOINT_IN
+            )
+            ep_out = usb.util.find_descriptor(
+                intf, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == usb.util.ENDPOINT_OUT
+            )
+            return intf, ep_in, ep_out
+    raise RuntimeError("vendor interface not found")
+
+
+def send(ep_out, frame_type, info=0, sequence=0):
+    ep_out.write(HEADER.pack(MAGIC, frame_type, 1, 0, info, sequence, 0))
+
+
+def main():
+    duration = float(sys.argv[1]) if len(sys.argv) > 1 else 10.0
+
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        print("PicoRX not found")
+        sys.exit(-1)
+    intf, ep_in, ep_out = find_interface(dev)
+    usb.util.claim_interface(dev, intf)
+
+    send(ep_out, START, (1 << SPECTRUM) | (1 << IQ) | (1 << STATUS_FRAME))
+
+    frames = {t: 0 for t in NAMES}
+    payload_bytes = 0
+    gaps = {t: 0 for t in NAMES}
+    last_sequence = {}
+    first_status = None
+    last_status = None
+    round_trips = []
+    ping_sequence = 0
+    ping_sent = None
+
+    buffer = b""
+    start = time.time()
+    last_ping = start
+    while time.time() - start < duration:
+        now = time.time()
+        if ping_sent is None and now - last_ping > 0.5:
+            ping_sequence += 1
+            ping_sent = now
+            last_ping = now
+            send(ep_out, PING, sequence=ping_sequence)
+
+        try:
+            buffer += bytes(ep_in.read(4096, timeout=100))
+        except usb.core.USBTimeoutError:
+            continue
+
+        while len(buffer) >= HEADER.size:
+            magic, frame_type, version, length, info, sequence, timestamp = HEADER.unpack_from(buffer)
+            if magic != MAGIC:
+                # resynchronise on the next magic number
+                buffer = buffer[1:]
+                continue
+            if len(buffer) < HEADER.size + length:
+                break
+            payload = buffer[HEADER.size : HEADER.size + length]
+            buffer = buffer[HEADER.size + length :]
+
+            if frame_type == PING:
+                if sequence == ping_sequence and ping_sent is not None:
+                    round_trips.append(time.time() - ping_sent)
+                    ping_sent = None
+                continue
+
+            if frame_type not in NAMES:
+                continue
+            frames[frame_type] += 1
+            payload_bytes += length
+            if frame_type in last_sequence and sequence != last_sequence[frame_type] + 1:
+                gaps[frame_type] += 1
+            last_sequence[frame_type] = sequence
+
+            if frame_type == STATUS_FRAME:
+                last_status = (timestamp, STATUS.unpack(payload))
+                if first_status is None:
+                    first_status = last_status
+
+    send(ep_out, STOP)
+    usb.util.release_interface(dev, intf)
+    elapsed = time.time() - start
+
+    for frame_type, name in NAMES.items():
+        print("%-8s %7.1f frames/s  %d sequence gaps" % (name, frames[frame_type] / elapsed, gaps[frame_type]))
+    print("payload  %7.1f kB/s" % (payload_bytes / elapsed / 1000))
+    if round_trips:
+        print("ping     %7.2f ms mean, %.2f ms max" % (1000 * sum(round_trips) / len(round_trips), 1000 * max(round_trips)))
+    if first_status and last_status and last_status[0] != first_status[0]:
+        device_time = (last_status[0] - first_status[0]) & 0xFFFFFFFF
+        busy = (last_status[1][10] - first_status[1][10]) & 0xFFFFFFFF
+        dropped = last_status[1][9] - first_status[1][9]
+        print("device   %7.2f %% of core 0 in stream task, %d frames dropped" % (100 * busy / device_time, dropped))
+
+
+if __name__ == "__main__":
+    main()
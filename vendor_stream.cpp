@@ -0,0 +1,78 @@
+#include "vendor_stream.h"
+
+#include "tusb.h"
+#include "pico/stdlib.h"
+
+static uint16_t enabled_streams = 0;
+static uint32_t dropped_frames = 0;
+
+//handle start, stop and ping frames from the host
+void vendor_stream_poll()
+{
+  if(!tud_vendor_mounted())
+  {
+    enabled_streams = 0;
+    return;
+  }
+
+  while(tud_vendor_available() >= sizeof(s_vendor_frame_header))
+  {
+    s_vendor_frame_header header;
+    tud_vendor_read(&header, sizeof(header));
+    if(header.magic != vendor_frame_magic || header.length)
+    {
+      //lost sync, throw away anything else that is queued
+      tud_vendor_read_flush();
+      break;
+    }
+
+    if(header.type == VENDOR_FRAME_START)
+    {
+      enabled_streams = header.info;
+    }
+    else if(header.type == VENDOR_FRAME_STOP)
+    {
+      enabled_streams = 0;
+    }
+    else if(header.type == VENDOR_FRAME_PING)
+    {
+      if(tud_vendor_write_available() >= sizeof(header))
+      {
+        tud_vendor_write(&header, sizeof(header));
+        tud_vendor_write_flush();
+      }
+    }
+  }
+}
+
+bool vendor_stream_enabled(uint8_t type)
+{
+  return enabled_streams & (1u << type);
+}
+
+//frames go straight from the producer's buffer into the endpoint fifo, a
+//frame is either sent whole or dropped and counted
+bool vendor_stream_send(uint8_t type, uint16_t info, uint32_t sequence, uint32_t timestamp_us,
+                        const void *payload, uint16_t length)
+{
+  if(!vendor_stream_enabled(type)) return false;
+
+  if(tud_vendor_write_available() < sizeof(s_vendor_frame_header) + length)
+  {
+    dropped_frames++;
+    return false;
+  }
+
+  s_vendor_frame_header header = {
+    vendor_frame_magic, type, vendor_frame_version, length, info, sequence, timestamp_us
+  };
+  tud_vendor_write(&header, sizeof(header));
+  tud_vendor_write(payload, length);
+  tud_vendor_write_flush();
+  return true;
+}
+
+uint32_t vendor_stream_dropped_frames()
+{
+  return dropped_frames;
+}
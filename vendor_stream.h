@@ -0,0 +1,57 @@
+#ifndef __VENDOR_STREAM_H__
+#define __VENDOR_STREAM_H__
+
+#include <cstdint>
+
+// framed binary messages over the vendor bulk interface
+//
+// every frame starts with a 16 byte little endian header followed by
+// length bytes of payload. The host enables streams with a start frame
+// whose info field is a mask of (1 << type).
+
+const uint16_t vendor_frame_magic = 0x5250; //"PR"
+const uint8_t  vendor_frame_version = 1u;
+
+// device to host
+const uint8_t  VENDOR_FRAME_SPECTRUM = 1u; //capture[] magnitudes in fft order, info = fft bin offset
+const uint8_t  VENDOR_FRAME_IQ = 2u;       //interleaved int16 IQ, info = sample rate / 10
+const uint8_t  VENDOR_FRAME_STATUS = 3u;   //s_vendor_status
+
+// host to device
+const uint8_t  VENDOR_FRAME_START = 0x10u; //info = mask of streams to send
+const uint8_t  VENDOR_FRAME_STOP = 0x11u;
+const uint8_t  VENDOR_FRAME_PING = 0x12u;  //echoed back unchanged
+
+struct __attribute__((packed)) s_vendor_frame_header
+{
+  uint16_t magic;
+  uint8_t  type;
+  uint8_t  version;
+  uint16_t length;
+  uint16_t info;
+  uint32_t sequence;
+  uint32_t timestamp_us;
+};
+
+struct __attribute__((packed)) s_vendor_status
+{
+  int16_t  signal_strength_dBm;
+  uint16_t battery;
+  uint16_t temp;
+  uint16_t busy_time;
+  uint32_t adc_overruns;
+  uint32_t dropped_blocks;
+  uint32_t audio_underruns;
+  uint32_t usb_dropped_samples;
+  uint32_t usb_duplicated_samples;
+  uint32_t vendor_dropped_frames;
+  uint32_t vendor_busy_time; //total us spent in the stream task
+};
+
+void vendor_stream_poll();
+bool vendor_stream_enabled(uint8_t type);
+bool vendor_stream_send(uint8_t type, uint16_t info, uint32_t sequence, uint32_t timestamp_us,
+                        const void *payload, uint16_t length);
+uint32_t vendor_stream_dropped_frames();
+
+#endif